@@ -0,0 +1,451 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <variant>
+#include "depth_snapshot.hpp"
+#include "order_book_shared.hpp"
+#include "orders/hash_order_table.hpp"
+#include "levels/eytzinger_levels.hpp"
+#include "levels/vector_levels_b_search_split.hpp"
+#include "levels/window_levels.hpp"
+
+namespace OB {
+
+// Order book which picks its level store per instrument. The stores live in a
+// std::variant, so every level operation is one switch on the variant index
+// and a direct call, there is no virtual dispatch.
+//
+// While orders flow the book counts, per window of level operations, the depth
+// of its sides, the level churn (levels created or emptied) and how many adds
+// land close to the touch. From that it picks a store:
+//  - Split for thin books, a short sorted vector is hard to beat
+//  - Window when the depth and the churn sit near the touch
+//  - Eytzinger for deep books which are also active away from the touch
+// A store has to win two windows in a row before the book moves to it.
+//
+// The move copies the levels into the new store during an idle tick, or right
+// away if no idle tick came for a few windows. The handles of the resting
+// orders are not rewritten during the move. Every Order remembers the store
+// generation its handle belongs to and an order from an older generation looks
+// its level up by price the first time it is touched again.
+//
+// Cent is one cent in the prices the book is given: 100 for ITCH prices, 1
+// for the tick indices of a PriceCodec (see TickOrderBook).
+enum class LevelStore : uint8_t {
+    Split,
+    Window,
+    Eytzinger
+};
+
+template<template<Side> typename Levels>
+struct LevelPair {
+    Levels<Side::Bid> bid;
+    Levels<Side::Ask> ask;
+};
+
+struct AdaptiveStats {
+    uint64_t ops = 0;       // level adds and removes
+    uint64_t adds = 0;
+    uint64_t near_adds = 0; // adds within near_band() of the touch
+    uint64_t churn = 0;     // levels created or emptied
+    size_t depth = 0;       // deepest side
+};
+
+template<typename Orders = HashOrderTable<>, uint32_t Cent = 100>
+class AdaptiveOrderBook {
+public:
+    explicit AdaptiveOrderBook(LevelStore initial = LevelStore::Split)
+        : stores(make_stores(initial)), candidate(initial), target(initial) {}
+
+    BestLvlChange add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price);
+    BestLvlChange cancel_order(uint64_t order_id, uint32_t qty);
+    BestLvlChange execute_order(uint64_t order_id, uint32_t qty);
+    BestLvlChange replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price);
+    BestLvlChange delete_order(uint64_t order_id);
+
+    Level best_bid();
+    Level best_ask();
+
+    template<size_t N>
+    DepthSnapshot<N> depth() const;
+
+    void idle();
+    void seed_reference_price(uint32_t price);
+
+    // see OrderBook::reprice, the orders come out with handles of the current
+    // store generation
+    template<typename F>
+    void reprice(F&& map);
+
+    // issued ahead of the operation on order_id, see Handler::prefetch
+    void prefetch_order(uint64_t order_id) const {
+        orders_map.prefetch(order_id);
+    }
+
+    LevelStore store() const {
+        return LevelStore(stores.index());
+    }
+
+    // the statistics of the last complete window
+    const AdaptiveStats& stats() const {
+        return last_window;
+    }
+
+    // the level changes of the last operation, see OrderBook::deltas
+    std::array<LevelDelta, 2> deltas;
+
+    uint64_t migrations = 0;
+    uint64_t max_orders = 0;
+    Orders orders_map;
+
+private:
+    template<Side S>
+    using Window = WindowLevelsT<S, Cent>;
+
+    using Stores = std::variant<
+        LevelPair<VectorLevelBSearchSplit>,
+        LevelPair<Window>,
+        LevelPair<EytzingerLevels>
+    >;
+
+    static constexpr uint64_t window_ops = 1 << 16;
+    static constexpr uint32_t forced_after_windows = 8;
+    static constexpr size_t deep_levels = 1500;
+    static constexpr size_t window_min_depth = 100;
+
+    static Stores make_stores(LevelStore store);
+    static uint32_t near_band(uint32_t best_price);
+
+    template<typename F>
+    auto on_side(Side side, F&& f);
+
+    BestLvlChange add_level(Side side, Level level, LevelHandle& handle);
+    // left: the order leaves the level for good, see OB::order_left
+    BestLvlChange remove_level(Side side, LevelHandle handle, uint64_t qty, bool left);
+    void remap(Order& order);
+
+    void end_window();
+    [[gnu::cold, gnu::noinline]] void migrate(LevelStore next);
+
+    Stores stores;
+    uint8_t generation = 0;
+
+    AdaptiveStats window;
+    AdaptiveStats last_window;
+    LevelStore candidate;
+    LevelStore target;
+    uint32_t waiting_windows = 0;
+};
+
+template<typename Orders, uint32_t Cent>
+typename AdaptiveOrderBook<Orders, Cent>::Stores AdaptiveOrderBook<Orders, Cent>::make_stores(LevelStore store) {
+    switch (store) {
+        case LevelStore::Window:
+            return Stores(std::in_place_index<1>);
+        case LevelStore::Eytzinger:
+            return Stores(std::in_place_index<2>);
+        default:
+            return Stores(std::in_place_index<0>);
+    }
+}
+
+// about 0.4% of the price, at least one cent
+template<typename Orders, uint32_t Cent>
+inline uint32_t AdaptiveOrderBook<Orders, Cent>::near_band(uint32_t best_price) {
+    return std::max<uint32_t>(best_price / 256, Cent);
+}
+
+template<typename Orders, uint32_t Cent>
+template<typename F>
+inline auto AdaptiveOrderBook<Orders, Cent>::on_side(Side side, F&& f) {
+    return std::visit([&](auto& pair) {
+        return side == Side::Bid ? f(pair.bid) : f(pair.ask);
+    }, stores);
+}
+
+template<typename Orders, uint32_t Cent>
+inline BestLvlChange AdaptiveOrderBook<Orders, Cent>::add_level(Side side, Level level, LevelHandle& handle) {
+    BestLvlChange change = on_side(side, [&](auto& levels) {
+        size_t depth = levels.size();
+        Level best = levels.best();
+
+        BestLvlChange change = levels.add(level, handle);
+
+        uint32_t distance = best.price > level.price ? best.price - level.price : level.price - best.price;
+        window.near_adds += best.qty == 0 || distance <= near_band(best.price);
+        if (levels.size() != depth) {
+            window.churn++;
+            window.depth = std::max(window.depth, depth + 1);
+        }
+
+        return change;
+    });
+
+    window.adds++;
+    if (++window.ops == window_ops) [[unlikely]] {
+        end_window();
+    }
+
+    return change;
+}
+
+template<typename Orders, uint32_t Cent>
+inline BestLvlChange AdaptiveOrderBook<Orders, Cent>::remove_level(Side side, LevelHandle handle, uint64_t qty, bool left) {
+    BestLvlChange change = on_side(side, [&](auto& levels) {
+        if (left) {
+            order_left(levels, handle);
+        }
+
+        size_t depth = levels.size();
+        BestLvlChange change = levels.remove(handle, qty);
+        window.churn += levels.size() != depth;
+        return change;
+    });
+
+    if (++window.ops == window_ops) [[unlikely]] {
+        end_window();
+    }
+
+    return change;
+}
+
+template<typename Orders, uint32_t Cent>
+inline void AdaptiveOrderBook<Orders, Cent>::remap(Order& order) {
+    if (order.generation == generation) [[likely]] {
+        return;
+    }
+
+    bool found = on_side(order.side, [&](auto& levels) {
+        return levels.find(order.price, order.level);
+    });
+    UNEXPECTED(!found, "Remap did not find the level of an order");
+    order.generation = generation;
+}
+
+template<typename Orders, uint32_t Cent>
+void AdaptiveOrderBook<Orders, Cent>::end_window() {
+    double near_share = window.adds == 0 ? 1.0 : double(window.near_adds) / double(window.adds);
+
+    LevelStore want = LevelStore::Split;
+    if (window.depth >= deep_levels && near_share < 0.9) {
+        want = LevelStore::Eytzinger;
+    } else if (window.depth >= window_min_depth && near_share >= 0.9 && window.churn * 4 >= window.ops) {
+        want = LevelStore::Window;
+    }
+
+    if (want == candidate) {
+        target = want;
+    }
+    candidate = want;
+
+    last_window = window;
+    window = {};
+    window.depth = on_side(Side::Bid, [](auto& levels) { return levels.size(); });
+    window.depth = std::max(window.depth, on_side(Side::Ask, [](auto& levels) { return levels.size(); }));
+
+    if (target == store()) {
+        waiting_windows = 0;
+    } else if (++waiting_windows >= forced_after_windows) {
+        migrate(target); // the feed never went idle
+    }
+}
+
+template<typename Orders, uint32_t Cent>
+void AdaptiveOrderBook<Orders, Cent>::migrate(LevelStore next) {
+    // the generation must not wrap around, an order left behind 256 moves ago
+    // would take a stale handle for a current one
+    if (generation == UINT8_MAX) {
+        target = store();
+        return;
+    }
+
+    Stores fresh = make_stores(next);
+    std::visit([](auto& from, auto& to) {
+        if constexpr (requires { to.bid.seed(0u); }) {
+            if (from.bid.size() != 0) {
+                to.bid.seed(from.bid.best().price);
+            }
+            if (from.ask.size() != 0) {
+                to.ask.seed(from.ask.best().price);
+            }
+        }
+
+        LevelHandle handle;
+        from.bid.for_each([&](const Level& level) { to.bid.add(level, handle); });
+        from.ask.for_each([&](const Level& level) { to.ask.add(level, handle); });
+    }, stores, fresh);
+
+    stores = std::move(fresh);
+    generation++;
+    migrations++;
+    waiting_windows = 0;
+}
+
+template<typename Orders, uint32_t Cent>
+void AdaptiveOrderBook<Orders, Cent>::idle() {
+    if (target != store()) {
+        migrate(target);
+        return;
+    }
+
+    std::visit([](auto& pair) {
+        if constexpr (requires { pair.bid.compact(); }) {
+            pair.bid.compact();
+            pair.ask.compact();
+        }
+    }, stores);
+}
+
+template<typename Orders, uint32_t Cent>
+void AdaptiveOrderBook<Orders, Cent>::seed_reference_price(uint32_t price) {
+    std::visit([&](auto& pair) {
+        if constexpr (requires { pair.bid.seed(price); }) {
+            pair.bid.seed(price);
+            pair.ask.seed(price);
+        }
+    }, stores);
+}
+
+template<typename Orders, uint32_t Cent>
+template<typename F>
+void AdaptiveOrderBook<Orders, Cent>::reprice(F&& map) {
+    orders_map.for_each([&](Order& order) {
+        remap(order);
+        on_side(order.side, [&](auto& levels) {
+            order_left(levels, order.level);
+            levels.remove(order.level, order.qty);
+        });
+    });
+
+    orders_map.for_each([&](Order& order) {
+        order.price = map(order.price);
+        order.generation = generation;
+        on_side(order.side, [&](auto& levels) {
+            levels.add({order.qty, order.price, 1}, order.level);
+        });
+    });
+}
+
+template<typename Orders, uint32_t Cent>
+Level AdaptiveOrderBook<Orders, Cent>::best_bid() {
+    return std::visit([](auto& pair) { return pair.bid.best(); }, stores);
+}
+
+template<typename Orders, uint32_t Cent>
+Level AdaptiveOrderBook<Orders, Cent>::best_ask() {
+    return std::visit([](auto& pair) { return pair.ask.best(); }, stores);
+}
+
+template<typename Orders, uint32_t Cent>
+template<size_t N>
+DepthSnapshot<N> AdaptiveOrderBook<Orders, Cent>::depth() const {
+    DepthSnapshot<N> snapshot;
+    std::visit([&](const auto& pair) {
+        fill_depth(pair.bid, snapshot.bid);
+        fill_depth(pair.ask, snapshot.ask);
+    }, stores);
+    return snapshot;
+}
+
+template<typename Orders, uint32_t Cent>
+BestLvlChange AdaptiveOrderBook<Orders, Cent>::add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price) {
+    Order order;
+    order.qty = qty;
+    order.side = side;
+    order.price = price;
+    order.generation = generation;
+
+    deltas[0] = {int64_t(qty), price, 1, side};
+
+    BestLvlChange best_lvl_change = add_level(side, {qty, price, 1}, order.level);
+    orders_map.insert(order_id, order);
+
+    return best_lvl_change;
+}
+
+template<typename Orders, uint32_t Cent>
+BestLvlChange AdaptiveOrderBook<Orders, Cent>::cancel_order(uint64_t order_id, uint32_t qty) {
+    Order* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Cancel order did not find an order");
+    Order& order = *order_ptr;
+    UNEXPECTED(order.qty < qty, "Partial cancel order volume greater than order volume");
+
+    deltas[0] = {-int64_t(qty), order.price, int8_t(order.qty == qty ? -1 : 0), order.side};
+
+    remap(order);
+    BestLvlChange best_lvl_change = remove_level(order.side, order.level, qty, order.qty == qty);
+
+    order.qty -= qty;
+    if (order.qty == 0) {
+        orders_map.erase(order_id);
+    }
+
+    return best_lvl_change;
+}
+
+template<typename Orders, uint32_t Cent>
+BestLvlChange AdaptiveOrderBook<Orders, Cent>::execute_order(uint64_t order_id, uint32_t qty) {
+    Order* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Execute order did not find an order");
+    Order& order = *order_ptr;
+    UNEXPECTED(order.qty < qty, "Partial execute order volume greater than order volume");
+
+    deltas[0] = {-int64_t(qty), order.price, int8_t(order.qty == qty ? -1 : 0), order.side};
+
+    remap(order);
+    BestLvlChange best_lvl_change = remove_level(order.side, order.level, qty, order.qty == qty);
+
+    order.qty -= qty;
+    if (order.qty == 0) {
+        orders_map.erase(order_id);
+    }
+
+    return best_lvl_change;
+}
+
+template<typename Orders, uint32_t Cent>
+BestLvlChange AdaptiveOrderBook<Orders, Cent>::replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price) {
+    Order* old_order_ptr = orders_map.find(order_id);
+    UNEXPECTED(old_order_ptr == nullptr, "Replace order did not find an order");
+    Order& old_order = *old_order_ptr;
+    remap(old_order);
+
+    Order new_order;
+    new_order.side = old_order.side;
+    new_order.price = price;
+    new_order.qty = qty;
+
+    deltas[0] = {-int64_t(old_order.qty), old_order.price, -1, old_order.side};
+    deltas[1] = {int64_t(qty), price, 1, new_order.side};
+
+    // the removal may end a window and move the book to another store, the
+    // new order belongs to the store it is added to
+    BestLvlChange best_change_rem = remove_level(old_order.side, old_order.level, old_order.qty, true);
+    new_order.generation = generation;
+    BestLvlChange best_change_add = add_level(new_order.side, {qty, price, 1}, new_order.level);
+
+    orders_map.erase(order_id);
+    orders_map.insert(new_order_id, new_order);
+
+    if (best_change_add.side != Side::None) {
+        return best_change_add;
+    } else return best_change_rem;
+}
+
+template<typename Orders, uint32_t Cent>
+BestLvlChange AdaptiveOrderBook<Orders, Cent>::delete_order(uint64_t order_id) {
+    Order* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Delete order did not find an order");
+    Order& order = *order_ptr;
+
+    deltas[0] = {-int64_t(order.qty), order.price, -1, order.side};
+
+    remap(order);
+    BestLvlChange best_lvl_change = remove_level(order.side, order.level, order.qty, true);
+
+    orders_map.erase(order_id);
+    return best_lvl_change;
+}
+
+}
@@ -10,6 +10,7 @@
 #include <absl/container/flat_hash_map.h>
 #include <iostream>
 #include <fstream>
+#include <unistd.h>
 
 pid_t run_perf_report();
 pid_t run_perf_stat();
@@ -22,6 +23,40 @@ inline uint64_t monotonic_raw_ns() {
     return uint64_t(ts.tv_sec) * 1'000'000'000ull + uint64_t(ts.tv_nsec);
 }
 
+// resident set size of the process, from /proc/self/statm
+inline size_t resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    statm >> total_pages >> resident_pages;
+    return resident_pages * size_t(sysconf(_SC_PAGESIZE));
+}
+
+inline void print_latency_percentiles(const absl::flat_hash_map<uint64_t, uint64_t>& latency_distribution) {
+    std::vector<std::pair<uint64_t, uint64_t>> data(latency_distribution.begin(), latency_distribution.end());
+    std::sort(data.begin(), data.end());
+
+    uint64_t total = 0;
+    for (const auto& [latency_ns, count] : data) {
+        total += count;
+    }
+
+    const double percentiles[] = {0.5, 0.99, 0.999};
+    std::cout << "Latency";
+    for (double p : percentiles) {
+        uint64_t rank = uint64_t(p * total);
+        uint64_t seen = 0;
+        for (const auto& [latency_ns, count] : data) {
+            seen += count;
+            if (seen > rank) {
+                std::cout << " p" << p * 100 << " = " << latency_ns << "ns";
+                break;
+            }
+        }
+    }
+    std::cout << '\n';
+}
+
 inline uint64_t cycles_to_ns(uint64_t cycles, uint64_t freq) {
     __int128 num = (__int128)cycles * 1'000'000'000 + (freq / 2);
     return (uint64_t)(num / freq);
@@ -2,15 +2,29 @@
 
 #include <benchmark/benchmark.h>
 #include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
 #include <absl/container/flat_hash_map.h>
+#include "adaptive_order_book.hpp"
 #include "itch_parser.hpp"
 #include "benchmarks/benchmark_utils.hpp"
+#include "levels/array_levels_v2.hpp"
+#include "levels/bitmap_levels.hpp"
+#include "levels/eytzinger_levels.hpp"
+#include "levels/gap_levels.hpp"
 #include "levels/vector_levels_b_search_split.hpp"
+#include "levels/window_levels.hpp"
+#include "l3_order_book.hpp"
 #include "order_book.hpp"
+#include "orders/paged_order_table.hpp"
 #include "order_book_shared.hpp"
+#include "tick_order_book.hpp"
 
+template<typename Book = OB::OrderBook<OB::VectorLevelBSearchSplit>>
 struct BenchmarkOrderBook {
     uint16_t target_stock_locate = -1;
+    std::string target_symbol;
 
     void handle(const ITCH::StockDirectory&);
     void handle(const ITCH::AddOrderNoMpid&);
@@ -27,7 +41,7 @@ struct BenchmarkOrderBook {
     void handle_before();
     void reset();
 
-    OB::OrderBook<OB::VectorLevelBSearchSplit> order_book;
+    Book order_book;
 
     bool touched = false;
     absl::flat_hash_map<uint64_t, uint64_t> latency_distribution;
@@ -44,7 +58,10 @@ struct BenchmarkOrderBook {
         return last_message;
     }
 
-    BenchmarkOrderBook() {
+    // the symbol is padded with spaces to the 8 characters of the ITCH stock field
+    explicit BenchmarkOrderBook(std::string_view symbol = "NVDA") : target_symbol(8, ' ') {
+        std::memcpy(target_symbol.data(), symbol.data(), std::min<size_t>(symbol.size(), 8));
+
         #ifndef PERF
         prices.reserve(60'000);
         prices.push_back({0, 0});
@@ -52,14 +69,16 @@ struct BenchmarkOrderBook {
     }
 };
 
-inline void BenchmarkOrderBook::handle_before() {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle_before() {
     #ifndef PERF
     touched = false;
     t0 = monotonic_raw_ns();
     #endif
 }
 
-inline void BenchmarkOrderBook::handle_after() {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle_after() {
     uint32_t best_bid = order_book.best_bid().price;
 
     #ifdef PERF
@@ -76,7 +95,8 @@ inline void BenchmarkOrderBook::handle_after() {
     #endif
 }
 
-inline void BenchmarkOrderBook::handle_change(const OB::BestLvlChange& best_lvl_change, uint64_t timestamp) {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle_change(const OB::BestLvlChange& best_lvl_change, uint64_t timestamp) {
     touched = true;
     total_messages++;
 
@@ -85,7 +105,8 @@ inline void BenchmarkOrderBook::handle_change(const OB::BestLvlChange& best_lvl_
     }
 }
 
-inline void BenchmarkOrderBook::handle(const ITCH::SystemEvent& msg) {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle(const ITCH::SystemEvent& msg) {
     if (msg.event_code == 'C') { // last message
         touched = true;
         last_message = true;
@@ -99,59 +120,121 @@ inline void BenchmarkOrderBook::handle(const ITCH::SystemEvent& msg) {
     }
 }
 
-inline void BenchmarkOrderBook::handle(const ITCH::StockDirectory& msg) {
-    if (std::string_view(msg.stock, 8) == "NVDA    ") {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle(const ITCH::StockDirectory& msg) {
+    if (std::string_view(msg.stock, 8) == target_symbol) {
         target_stock_locate = msg.stock_locate;
         touched = true;
         total_messages++;
     }
 }
 
-inline void BenchmarkOrderBook::handle(const ITCH::AddOrderNoMpid& msg) {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle(const ITCH::AddOrderNoMpid& msg) {
     if (msg.stock_locate == target_stock_locate) {
         auto change = order_book.add_order(msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
         handle_change(change, msg.timestamp);
     }
 }
 
-inline void BenchmarkOrderBook::handle(const ITCH::AddOrderMpid& msg) {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle(const ITCH::AddOrderMpid& msg) {
     if (msg.stock_locate == target_stock_locate) {
         auto change = order_book.add_order(msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
         handle_change(change, msg.timestamp);
     }
 }
 
-inline void BenchmarkOrderBook::handle(const ITCH::OrderExecuted& msg) {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle(const ITCH::OrderExecuted& msg) {
     if (msg.stock_locate == target_stock_locate) {
         auto change = order_book.execute_order(msg.order_reference_number, msg.executed_shares);
         handle_change(change, msg.timestamp);
     }
 }
 
-inline void BenchmarkOrderBook::handle(const ITCH::OrderExecutedPrice& msg) {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle(const ITCH::OrderExecutedPrice& msg) {
     if (msg.stock_locate == target_stock_locate) {
         auto change = order_book.execute_order(msg.order_reference_number, msg.executed_shares);
         handle_change(change, msg.timestamp);
     }
 }
 
-inline void BenchmarkOrderBook::handle(const ITCH::OrderCancel& msg) {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle(const ITCH::OrderCancel& msg) {
     if (msg.stock_locate == target_stock_locate) {
         auto change = order_book.cancel_order(msg.order_reference_number, msg.cancelled_shares);
         handle_change(change, msg.timestamp);
     }
 }
 
-inline void BenchmarkOrderBook::handle(const ITCH::OrderDelete& msg) {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle(const ITCH::OrderDelete& msg) {
     if (msg.stock_locate == target_stock_locate) {
         auto change = order_book.delete_order(msg.order_reference_number);
         handle_change(change, msg.timestamp);
     }
 }
 
-inline void BenchmarkOrderBook::handle(const ITCH::OrderReplace& msg) {
+template<typename Book>
+inline void BenchmarkOrderBook<Book>::handle(const ITCH::OrderReplace& msg) {
     if (msg.stock_locate == target_stock_locate) {
         auto change = order_book.replace_order(msg.order_reference_number, msg.new_reference_number, msg.shares, msg.price);
         handle_change(change, msg.timestamp);
     }
 }
+
+// same replay with the order ids resolved through the paged direct index
+// instead of the hash map
+using BenchmarkPagedOrderBook = BenchmarkOrderBook<
+    OB::OrderBook<OB::VectorLevelBSearchSplit, OB::PagedOrderTable<>>
+>;
+
+// order by order book, shows what the per level FIFOs cost on top of the
+// aggregated book
+using BenchmarkL3OrderBook = BenchmarkOrderBook<
+    OB::L3OrderBook<OB::VectorLevelBSearchSplit>
+>;
+
+// dense ladders, the bitmap finds the next best level without scanning, run
+// them on the deepest symbols of the day next to the default book
+using BenchmarkArrayLevelsV2 = BenchmarkOrderBook<
+    OB::OrderBook<OB::ArrayLevelsV2>
+>;
+
+using BenchmarkBitmapLevels = BenchmarkOrderBook<
+    OB::OrderBook<OB::BitmapLevels>
+>;
+
+// the bitmap ladder over cent indices instead of ITCH prices, one slot per
+// cent covers prices up to about 20000$ in the same 2M slots
+template<typename Book>
+struct CentTickOrderBook : OB::TickOrderBook<Book> {
+    CentTickOrderBook() : OB::TickOrderBook<Book>(OB::PriceCodec(100)) {}
+};
+
+using BenchmarkTickBitmapLevels = BenchmarkOrderBook<
+    CentTickOrderBook<OB::OrderBook<OB::BitmapLevels>>
+>;
+
+// dense window around the touch with the far levels in a btree
+using BenchmarkWindowLevels = BenchmarkOrderBook<
+    OB::OrderBook<OB::WindowLevels>
+>;
+
+// split layout which leaves tombstones instead of shifting the whole tail
+using BenchmarkGapLevels = BenchmarkOrderBook<
+    OB::OrderBook<OB::GapLevels>
+>;
+
+// for the symbols with thousands of live levels
+using BenchmarkEytzingerLevels = BenchmarkOrderBook<
+    OB::OrderBook<OB::EytzingerLevels>
+>;
+
+// the store is picked from the flow of the symbol, it only moves to another
+// one when the ingest goes idle or after a few windows without an idle tick
+using BenchmarkAdaptiveOrderBook = BenchmarkOrderBook<
+    OB::AdaptiveOrderBook<>
+>;
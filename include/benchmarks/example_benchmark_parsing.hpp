@@ -1,6 +1,8 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <iostream>
 #include <absl/container/flat_hash_map.h>
 #include <benchmark/benchmark.h>
 #include "itch_parser.hpp"
@@ -43,9 +45,17 @@ struct BenchmarkParsing {
     void handle_before();
     void reset();
 
+    // mean latency of every message type, build with ITCH_SCALAR_DECODE to
+    // compare the decode kernels against the scalar loads
+    void print_type_latencies() const;
+
     absl::flat_hash_map<uint64_t, uint64_t> latency_distribution;
     uint64_t total_messages = 0;
     uint64_t t0;
+
+    char type = 0;
+    std::array<uint64_t, 256> type_ns{};
+    std::array<uint64_t, 256> type_messages{};
 };
 
 inline void BenchmarkParsing::handle_before() {
@@ -60,34 +70,119 @@ inline void BenchmarkParsing::handle_after() {
     auto latency_ns = t1 - t0;
     latency_distribution[latency_ns]++;
     total_messages++;
+    type_ns[uint8_t(type)] += latency_ns;
+    type_messages[uint8_t(type)]++;
+}
+
+inline void BenchmarkParsing::print_type_latencies() const {
+    for (int t = 0; t < 256; ++t) {
+        if (type_messages[t] != 0) {
+            std::cout << char(t) << ": " << type_messages[t] << " messages, "
+                      << double(type_ns[t]) / double(type_messages[t]) << "ns mean\n";
+        }
+    }
 }
 
-#define DEF_HANDLER(T) \
+#define DEF_HANDLER(RAW_TYPE, T) \
 inline void BenchmarkParsing::handle(T msg) { \
+    type = RAW_TYPE; \
     consume(msg); \
 }
 
-DEF_HANDLER(ITCH::AddOrderNoMpid)
-DEF_HANDLER(ITCH::OrderCancel)
-DEF_HANDLER(ITCH::OrderDelete)
-DEF_HANDLER(ITCH::OrderReplace)
-DEF_HANDLER(ITCH::SystemEvent)
-DEF_HANDLER(ITCH::StockDirectory)
-DEF_HANDLER(ITCH::TradingAction)
-DEF_HANDLER(ITCH::RegSho)
-DEF_HANDLER(ITCH::MarketParticipantPos)
-DEF_HANDLER(ITCH::MwcbDeclineLevel)
-DEF_HANDLER(ITCH::MwcbStatus)
-DEF_HANDLER(ITCH::IpoQuotationPeriodUpd)
-DEF_HANDLER(ITCH::LuldAuctionCollar)
-DEF_HANDLER(ITCH::OperationalHalt)
-DEF_HANDLER(ITCH::AddOrderMpid)
-DEF_HANDLER(ITCH::OrderExecuted)
-DEF_HANDLER(ITCH::OrderExecutedPrice)
-DEF_HANDLER(ITCH::TradeMessageNonCross)
-DEF_HANDLER(ITCH::TradeMessageCross)
-DEF_HANDLER(ITCH::BrokenTrade)
-DEF_HANDLER(ITCH::Noii)
-DEF_HANDLER(ITCH::DirectListingCapitalRaise)
+DEF_HANDLER('A', ITCH::AddOrderNoMpid)
+DEF_HANDLER('X', ITCH::OrderCancel)
+DEF_HANDLER('D', ITCH::OrderDelete)
+DEF_HANDLER('U', ITCH::OrderReplace)
+DEF_HANDLER('S', ITCH::SystemEvent)
+DEF_HANDLER('R', ITCH::StockDirectory)
+DEF_HANDLER('H', ITCH::TradingAction)
+DEF_HANDLER('Y', ITCH::RegSho)
+DEF_HANDLER('L', ITCH::MarketParticipantPos)
+DEF_HANDLER('V', ITCH::MwcbDeclineLevel)
+DEF_HANDLER('W', ITCH::MwcbStatus)
+DEF_HANDLER('K', ITCH::IpoQuotationPeriodUpd)
+DEF_HANDLER('J', ITCH::LuldAuctionCollar)
+DEF_HANDLER('h', ITCH::OperationalHalt)
+DEF_HANDLER('F', ITCH::AddOrderMpid)
+DEF_HANDLER('E', ITCH::OrderExecuted)
+DEF_HANDLER('C', ITCH::OrderExecutedPrice)
+DEF_HANDLER('P', ITCH::TradeMessageNonCross)
+DEF_HANDLER('Q', ITCH::TradeMessageCross)
+DEF_HANDLER('B', ITCH::BrokenTrade)
+DEF_HANDLER('I', ITCH::Noii)
+DEF_HANDLER('O', ITCH::DirectListingCapitalRaise)
 
 #undef DEF_HANDLER
+
+// What an order book reads of the order messages, once from the decoded
+// structs and once from views which decode only the fields read. The other
+// messages are timed as in BenchmarkParsing, the two latency distributions
+// differ by what decoding the unread fields costs.
+struct BenchmarkParsingOrderFields : BenchmarkParsing {
+    using BenchmarkParsing::handle;
+
+    inline void handle(ITCH::AddOrderNoMpid msg);
+    inline void handle(ITCH::AddOrderMpid msg);
+    inline void handle(ITCH::OrderExecuted msg);
+    inline void handle(ITCH::OrderExecutedPrice msg);
+    inline void handle(ITCH::OrderCancel msg);
+    inline void handle(ITCH::OrderDelete msg);
+    inline void handle(ITCH::OrderReplace msg);
+};
+
+struct BenchmarkParsingOrderViews : BenchmarkParsing {
+    using BenchmarkParsing::handle;
+
+    inline void handle(ITCH::MsgView<ITCH::AddOrderNoMpidLayout> msg);
+    inline void handle(ITCH::MsgView<ITCH::AddOrderMpidLayout> msg);
+    inline void handle(ITCH::MsgView<ITCH::OrderExecutedLayout> msg);
+    inline void handle(ITCH::MsgView<ITCH::OrderExecutedPriceLayout> msg);
+    inline void handle(ITCH::MsgView<ITCH::OrderCancelLayout> msg);
+    inline void handle(ITCH::MsgView<ITCH::OrderDeleteLayout> msg);
+    inline void handle(ITCH::MsgView<ITCH::OrderReplaceLayout> msg);
+};
+
+template<auto Member, typename Msg>
+inline auto field(const Msg& msg) {
+    return msg.*Member;
+}
+
+template<auto Member, typename Layout>
+inline auto field(const ITCH::MsgView<Layout>& msg) {
+    return msg.template get<Member>();
+}
+
+template<auto... Members, typename Msg>
+inline void consume_fields(const Msg& msg) {
+    ([&] {
+        auto value = field<Members>(msg);
+        benchmark::DoNotOptimize(value);
+    }(), ...);
+    benchmark::ClobberMemory();
+}
+
+#define DEF_ORDER_HANDLERS(RAW_TYPE, T, ...) \
+inline void BenchmarkParsingOrderFields::handle(ITCH::T msg) { \
+    type = RAW_TYPE; \
+    consume_fields<__VA_ARGS__>(msg); \
+} \
+inline void BenchmarkParsingOrderViews::handle(ITCH::MsgView<ITCH::T##Layout> msg) { \
+    type = RAW_TYPE; \
+    consume_fields<__VA_ARGS__>(msg); \
+}
+
+DEF_ORDER_HANDLERS('A', AddOrderNoMpid, &ITCH::AddOrderNoMpid::stock_locate, &ITCH::AddOrderNoMpid::order_reference_number,
+    &ITCH::AddOrderNoMpid::buy_sell, &ITCH::AddOrderNoMpid::shares, &ITCH::AddOrderNoMpid::price)
+DEF_ORDER_HANDLERS('F', AddOrderMpid, &ITCH::AddOrderMpid::stock_locate, &ITCH::AddOrderMpid::order_reference_number,
+    &ITCH::AddOrderMpid::buy_sell, &ITCH::AddOrderMpid::shares, &ITCH::AddOrderMpid::price)
+DEF_ORDER_HANDLERS('E', OrderExecuted, &ITCH::OrderExecuted::stock_locate, &ITCH::OrderExecuted::order_reference_number,
+    &ITCH::OrderExecuted::executed_shares)
+DEF_ORDER_HANDLERS('C', OrderExecutedPrice, &ITCH::OrderExecutedPrice::stock_locate, &ITCH::OrderExecutedPrice::order_reference_number,
+    &ITCH::OrderExecutedPrice::executed_shares)
+DEF_ORDER_HANDLERS('X', OrderCancel, &ITCH::OrderCancel::stock_locate, &ITCH::OrderCancel::order_reference_number,
+    &ITCH::OrderCancel::cancelled_shares)
+DEF_ORDER_HANDLERS('D', OrderDelete, &ITCH::OrderDelete::stock_locate, &ITCH::OrderDelete::order_reference_number)
+DEF_ORDER_HANDLERS('U', OrderReplace, &ITCH::OrderReplace::stock_locate, &ITCH::OrderReplace::order_reference_number,
+    &ITCH::OrderReplace::new_reference_number, &ITCH::OrderReplace::shares, &ITCH::OrderReplace::price)
+
+#undef DEF_ORDER_HANDLERS
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string_view>
+#include <vector>
+#include "benchmarks/benchmark_utils.hpp"
+#include "order_book_shared.hpp"
+
+// Creates and empties levels deep in the bid side of a level store, away from
+// the touch, and prints the latency percentiles of those operations. This is
+// where the sorted vector stores shift the most elements per new or emptied
+// level. The deepest `churn_depth` levels churn, the rest of the book stays.
+template<template<OB::Side> typename Levels>
+inline void run_level_churn_benchmark(
+    std::string_view name,
+    size_t depth = 4000,
+    size_t churn_depth = 2000,
+    size_t ops = 1 << 20
+) {
+    Levels<OB::Side::Bid> levels;
+    std::vector<OB::LevelHandle> handles(depth);
+    std::vector<bool> live(depth, true);
+
+    for (size_t i = 0; i < depth; ++i) {
+        levels.add({100, 10'000 + uint32_t(i) * 100}, handles[i]);
+    }
+
+    std::mt19937 rng(42);
+    std::vector<uint64_t> latencies;
+    latencies.reserve(ops);
+
+    for (size_t op = 0; op < ops; ++op) {
+        size_t i = rng() % std::min(churn_depth, depth);
+
+        uint64_t t0 = monotonic_raw_ns();
+        OB::BestLvlChange change;
+        if (live[i]) {
+            change = levels.remove(handles[i], 100);
+        } else {
+            change = levels.add({100, 10'000 + uint32_t(i) * 100}, handles[i]);
+        }
+        benchmark::DoNotOptimize(change);
+        latencies.push_back(monotonic_raw_ns() - t0);
+
+        live[i] = !live[i];
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))];
+    };
+
+    std::cout << name << " deep level churn (" << depth << " levels): p50 "
+              << percentile(0.5) << "ns, p99 " << percentile(0.99)
+              << "ns, p999 " << percentile(0.999) << "ns, max "
+              << latencies.back() << "ns\n";
+}
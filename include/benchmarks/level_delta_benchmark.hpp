@@ -0,0 +1,208 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <absl/container/flat_hash_map.h>
+#include "itch_parser.hpp"
+#include "benchmarks/benchmark_utils.hpp"
+#include "book_analytics.hpp"
+#include "handler.hpp"
+#include "l2_replica.hpp"
+#include "order_book.hpp"
+#include "order_book_shared.hpp"
+
+// Replays the day for one symbol and publishes every level delta of the book
+// through a strategy queue like Handler does. The latency covers the book
+// operation plus the pushes, so it compares directly with BenchmarkOrderBook.
+// A consumer on the same thread drains the queue after every message into an
+// L2Replica, its cost is reported separately, and at the end of the day the
+// replica has to agree with the book. The consumer also keeps BookAnalytics
+// on top of the replica, the way an analytics core fed by the deltas would.
+template<typename Book = OB::OrderBook<OB::VectorLevelBSearchSplit>>
+struct BenchmarkLevelDeltas {
+    uint16_t target_stock_locate = -1;
+    std::string target_symbol;
+
+    void handle(const ITCH::StockDirectory&);
+    void handle(const ITCH::AddOrderNoMpid&);
+    void handle(const ITCH::AddOrderMpid&);
+    void handle(const ITCH::OrderExecuted&);
+    void handle(const ITCH::OrderExecutedPrice&);
+    void handle(const ITCH::OrderCancel&);
+    void handle(const ITCH::OrderDelete&);
+    void handle(const ITCH::OrderReplace&);
+    void handle(const ITCH::SystemEvent&);
+
+    void publish(size_t count);
+    void handle_after();
+    void handle_before();
+    void report() const;
+
+    Book order_book;
+    Handler::Queue queue;
+    Handler::Queue::Consumer consumer = queue.make_consumer();
+    OB::L2Replica<> replica;
+    OB::BookAnalytics<> analytics;
+
+    bool touched = false;
+    absl::flat_hash_map<uint64_t, uint64_t> latency_distribution;
+
+    uint64_t t0;
+    uint64_t total_messages = 0;
+    uint64_t deltas = 0;
+    uint64_t apply_ns = 0;
+    uint64_t analytics_ns = 0;
+    uint64_t events[3] = {};
+    size_t pending = 0;
+
+    bool last_message = false;
+
+    bool should_stop() {
+        return last_message;
+    }
+
+    explicit BenchmarkLevelDeltas(std::string_view symbol = "NVDA") : target_symbol(8, ' ') {
+        std::memcpy(target_symbol.data(), symbol.data(), std::min<size_t>(symbol.size(), 8));
+    }
+};
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle_before() {
+    touched = false;
+    t0 = monotonic_raw_ns();
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle_after() {
+    uint64_t t1 = monotonic_raw_ns();
+    if (!touched) {
+        return;
+    }
+    latency_distribution[t1 - t0]++;
+
+    StrategyMsg msg;
+    while (consumer.pop(msg)) {
+        events[size_t(replica.apply(msg.level_update.delta))]++;
+    }
+    uint64_t t2 = monotonic_raw_ns();
+    apply_ns += t2 - t1;
+
+    // what the analytics core does with the same deltas once the replica has
+    // all of them, the deltas of a replace go in together
+    analytics.apply(order_book.deltas.data(), pending, replica, t1);
+    benchmark::DoNotOptimize(analytics.snapshot(t1));
+    analytics_ns += monotonic_raw_ns() - t2;
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::publish(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        queue.push(StrategyMsg{
+            .type = StrategyMsgType::LevelUpdate,
+            .level_update {
+                .t0 = t0,
+                .delta = order_book.deltas[i]
+            }
+        });
+    }
+
+    deltas += count;
+    pending = count;
+    touched = true;
+    total_messages++;
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::report() const {
+    bool in_sync = replica.template depth<20>() == order_book.template depth<20>();
+
+    std::cout << "Order messages: " << total_messages << '\n';
+    std::cout << "Level deltas: " << deltas << " (new " << events[0] << ", update " << events[1]
+              << ", removed " << events[2] << ")\n";
+    std::cout << "Replica apply: " << (deltas == 0 ? 0 : apply_ns / deltas) << "ns per delta, "
+              << (in_sync ? "in sync with the book" : "OUT OF SYNC with the book") << '\n';
+    std::cout << "Analytics on the replica: " << (deltas == 0 ? 0 : analytics_ns / deltas) << "ns per delta\n";
+    print_latency_percentiles(latency_distribution);
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle(const ITCH::SystemEvent& msg) {
+    if (msg.event_code == 'C') { // last message
+        last_message = true;
+        report();
+    }
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle(const ITCH::StockDirectory& msg) {
+    if (std::string_view(msg.stock, 8) == target_symbol) {
+        target_stock_locate = msg.stock_locate;
+    }
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle(const ITCH::AddOrderNoMpid& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        auto change = order_book.add_order(msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
+        benchmark::DoNotOptimize(change);
+        publish(1);
+    }
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle(const ITCH::AddOrderMpid& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        auto change = order_book.add_order(msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
+        benchmark::DoNotOptimize(change);
+        publish(1);
+    }
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle(const ITCH::OrderExecuted& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        auto change = order_book.execute_order(msg.order_reference_number, msg.executed_shares);
+        benchmark::DoNotOptimize(change);
+        publish(1);
+    }
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle(const ITCH::OrderExecutedPrice& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        auto change = order_book.execute_order(msg.order_reference_number, msg.executed_shares);
+        benchmark::DoNotOptimize(change);
+        publish(1);
+    }
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle(const ITCH::OrderCancel& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        auto change = order_book.cancel_order(msg.order_reference_number, msg.cancelled_shares);
+        benchmark::DoNotOptimize(change);
+        publish(1);
+    }
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle(const ITCH::OrderDelete& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        auto change = order_book.delete_order(msg.order_reference_number);
+        benchmark::DoNotOptimize(change);
+        publish(1);
+    }
+}
+
+template<typename Book>
+inline void BenchmarkLevelDeltas<Book>::handle(const ITCH::OrderReplace& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        auto change = order_book.replace_order(msg.order_reference_number, msg.new_reference_number, msg.shares, msg.price);
+        benchmark::DoNotOptimize(change);
+        publish(2);
+    }
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "itch_parser.hpp"
+#include "benchmarks/benchmark_utils.hpp"
+#include "levels/near_touch_search.hpp"
+#include "levels/vector_levels_b_search_split.hpp"
+#include "order_book.hpp"
+#include "order_book_shared.hpp"
+
+// Replays one symbol into the split level store and records how many levels
+// from the touch every level search lands: 0 is a new best price, 1 the best
+// level itself and so on. The distribution is then used to time the near touch
+// search against the plain binary search on a book of the same depth.
+struct BenchmarkLevelDistance {
+    using Book = OB::OrderBook<OB::VectorLevelBSearchSplit>;
+    static constexpr size_t max_distance = 1024; // the last bucket holds everything deeper
+
+    uint16_t target_stock_locate = -1;
+    std::string target_symbol;
+
+    void handle(const ITCH::StockDirectory&);
+    void handle(const ITCH::AddOrderNoMpid&);
+    void handle(const ITCH::AddOrderMpid&);
+    void handle(const ITCH::OrderExecuted&);
+    void handle(const ITCH::OrderExecutedPrice&);
+    void handle(const ITCH::OrderCancel&);
+    void handle(const ITCH::OrderDelete&);
+    void handle(const ITCH::OrderReplace&);
+    void handle(const ITCH::SystemEvent&);
+
+    void handle_after() {}
+    void handle_before() {}
+
+    void export_distance_csv(std::string file_name) const;
+    void run_search_benchmark() const;
+
+    Book order_book;
+
+    std::array<uint64_t, max_distance + 1> add_distance{};
+    std::array<uint64_t, max_distance + 1> remove_distance{};
+    size_t max_depth = 0;
+
+    bool last_message = false;
+
+    bool should_stop() {
+        return last_message;
+    }
+
+    explicit BenchmarkLevelDistance(std::string_view symbol = "NVDA") : target_symbol(8, ' ') {
+        std::memcpy(target_symbol.data(), symbol.data(), std::min<size_t>(symbol.size(), 8));
+    }
+
+private:
+    size_t distance(OB::Side side, uint32_t price) const;
+    void record_add(OB::Side side, uint32_t price);
+    void record_remove(uint64_t order_id);
+};
+
+inline size_t BenchmarkLevelDistance::distance(OB::Side side, uint32_t price) const {
+    const auto& prices = side == OB::Side::Bid ? order_book.bid_levels.prices : order_book.ask_levels.prices;
+
+    size_t idx;
+    if (side == OB::Side::Bid) {
+        idx = OB::binary_search_idx<OB::Side::Bid>(prices.data(), prices.size(), price);
+    } else {
+        idx = OB::binary_search_idx<OB::Side::Ask>(prices.data(), prices.size(), price);
+    }
+
+    return std::min(prices.size() - idx, max_distance);
+}
+
+inline void BenchmarkLevelDistance::record_add(OB::Side side, uint32_t price) {
+    add_distance[distance(side, price)]++;
+    max_depth = std::max({max_depth, order_book.bid_levels.prices.size(), order_book.ask_levels.prices.size()});
+}
+
+inline void BenchmarkLevelDistance::record_remove(uint64_t order_id) {
+    const OB::Order* order = order_book.orders_map.find(order_id);
+    OB::UNEXPECTED(order == nullptr, "Level distance did not find an order");
+    remove_distance[distance(order->side, order->price)]++;
+}
+
+inline void BenchmarkLevelDistance::handle(const ITCH::SystemEvent& msg) {
+    if (msg.event_code == 'C') { // last message
+        last_message = true;
+    }
+}
+
+inline void BenchmarkLevelDistance::handle(const ITCH::StockDirectory& msg) {
+    if (std::string_view(msg.stock, 8) == target_symbol) {
+        target_stock_locate = msg.stock_locate;
+    }
+}
+
+inline void BenchmarkLevelDistance::handle(const ITCH::AddOrderNoMpid& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        record_add(static_cast<OB::Side>(msg.buy_sell), msg.price);
+        order_book.add_order(msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
+    }
+}
+
+inline void BenchmarkLevelDistance::handle(const ITCH::AddOrderMpid& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        record_add(static_cast<OB::Side>(msg.buy_sell), msg.price);
+        order_book.add_order(msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
+    }
+}
+
+inline void BenchmarkLevelDistance::handle(const ITCH::OrderExecuted& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        record_remove(msg.order_reference_number);
+        order_book.execute_order(msg.order_reference_number, msg.executed_shares);
+    }
+}
+
+inline void BenchmarkLevelDistance::handle(const ITCH::OrderExecutedPrice& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        record_remove(msg.order_reference_number);
+        order_book.execute_order(msg.order_reference_number, msg.executed_shares);
+    }
+}
+
+inline void BenchmarkLevelDistance::handle(const ITCH::OrderCancel& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        record_remove(msg.order_reference_number);
+        order_book.cancel_order(msg.order_reference_number, msg.cancelled_shares);
+    }
+}
+
+inline void BenchmarkLevelDistance::handle(const ITCH::OrderDelete& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        record_remove(msg.order_reference_number);
+        order_book.delete_order(msg.order_reference_number);
+    }
+}
+
+inline void BenchmarkLevelDistance::handle(const ITCH::OrderReplace& msg) {
+    if (msg.stock_locate == target_stock_locate) {
+        record_remove(msg.order_reference_number);
+        record_add(order_book.orders_map.find(msg.order_reference_number)->side, msg.price);
+        order_book.replace_order(msg.order_reference_number, msg.new_reference_number, msg.shares, msg.price);
+    }
+}
+
+inline void BenchmarkLevelDistance::export_distance_csv(std::string file_name) const {
+    std::ofstream out(file_name);
+    if (!out) {
+        std::abort();
+    }
+
+    out << "distance,adds,removes\n";
+    for (size_t d = 0; d <= max_distance; ++d) {
+        if (add_distance[d] != 0 || remove_distance[d] != 0) {
+            out << d << "," << add_distance[d] << "," << remove_distance[d] << "\n";
+        }
+    }
+}
+
+// the searches are drawn from the recorded distances over a bid side as deep
+// as the deepest side seen in the replay
+inline void BenchmarkLevelDistance::run_search_benchmark() const {
+    constexpr size_t searches = 1 << 20;
+    size_t depth = std::max<size_t>(max_depth, 1);
+
+    std::vector<uint32_t> prices(depth);
+    for (size_t i = 0; i < depth; ++i) {
+        prices[i] = 10'000 + uint32_t(i) * 100;
+    }
+
+    std::vector<double> weights(max_distance + 1);
+    for (size_t d = 0; d <= max_distance; ++d) {
+        weights[d] = double(add_distance[d] + remove_distance[d]);
+    }
+
+    std::mt19937 rng(42);
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+    std::vector<uint32_t> queries(searches);
+    for (auto& query : queries) {
+        size_t d = std::min(pick(rng), depth);
+        query = d == 0 ? prices.back() + 100 : prices[depth - d];
+    }
+
+    auto time = [&](auto search) {
+        uint64_t t0 = monotonic_raw_ns();
+        for (uint32_t query : queries) {
+            size_t idx = search(prices.data(), prices.size(), query);
+            benchmark::DoNotOptimize(idx);
+        }
+        return double(monotonic_raw_ns() - t0) / searches;
+    };
+
+    double binary_ns = time(OB::binary_search_idx<OB::Side::Bid>);
+    double near_touch_ns = time(OB::near_touch_idx<OB::Side::Bid>);
+
+    std::cout << "Level search depth: " << depth
+              << ", lanes: " << OB::near_touch_lanes << '\n';
+    std::cout << "Binary search: " << binary_ns << " ns/search\n";
+    std::cout << "Near touch search: " << near_touch_ns << " ns/search\n";
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <iostream>
+#include <absl/container/flat_hash_map.h>
+#include "itch_parser.hpp"
+#include "benchmarks/benchmark_utils.hpp"
+#include "levels/compact_levels.hpp"
+#include "market_order_book.hpp"
+#include "orders/hash_order_table.hpp"
+#include "order_book_shared.hpp"
+
+// Builds the book of every instrument of the day through the shared market
+// order table and reports the latency of the order messages and the memory
+// it took at the end of the day. The packets are timed as well, with
+// Pipelined and the ingestor in a batched mode the order table slots of a
+// packet are all prefetched before its first message is applied.
+template<typename Book = OB::MarketOrderBook<>, bool Pipelined = false>
+struct BenchmarkMarketOrderBook {
+    void handle(const ITCH::AddOrderNoMpid&);
+    void handle(const ITCH::AddOrderMpid&);
+    void handle(const ITCH::OrderExecuted&);
+    void handle(const ITCH::OrderExecutedPrice&);
+    void handle(const ITCH::OrderCancel&);
+    void handle(const ITCH::OrderDelete&);
+    void handle(const ITCH::OrderReplace&);
+    void handle(const ITCH::SystemEvent&);
+
+    void handle_after();
+    void handle_before();
+    void handle_packet_begin();
+    void handle_packet_end();
+    void prefetch(const std::byte* msg) requires Pipelined;
+    void report() const;
+
+    // taken before the book is constructed, so the pre-sized table counts
+    size_t start_rss = resident_bytes();
+    Book order_book;
+
+    bool touched = false;
+    absl::flat_hash_map<uint64_t, uint64_t> latency_distribution;
+    absl::flat_hash_map<uint64_t, uint64_t> packet_latency_distribution;
+
+    uint64_t total_messages = 0;
+    uint64_t t0;
+    uint64_t packet_t0;
+    uint64_t packet_ns = 0;
+
+    bool last_message = false;
+
+    bool should_stop() {
+        return last_message;
+    }
+};
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle_before() {
+    #ifndef PERF
+    touched = false;
+    t0 = monotonic_raw_ns();
+    #endif
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle_after() {
+    #ifndef PERF
+    uint64_t t1 = monotonic_raw_ns();
+    if (touched) {
+        latency_distribution[t1 - t0]++;
+    }
+    #endif
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle_packet_begin() {
+    packet_t0 = monotonic_raw_ns();
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle_packet_end() {
+    uint64_t ns = monotonic_raw_ns() - packet_t0;
+    packet_latency_distribution[ns]++;
+    packet_ns += ns;
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::prefetch(const std::byte* msg) requires Pipelined {
+    const std::byte* fields = msg + 1;
+    switch (char(msg[0])) {
+        case 'E': case 'C': case 'X': case 'D': case 'U':
+            // the order reference follows the locate, tracking number and timestamp on all of them
+            order_book.prefetch_order(ITCH::MsgView<ITCH::OrderDeleteLayout>(fields).template get<&ITCH::OrderDelete::order_reference_number>());
+            break;
+        case 'A':
+            order_book.prefetch_order(ITCH::MsgView<ITCH::AddOrderNoMpidLayout>(fields).template get<&ITCH::AddOrderNoMpid::order_reference_number>());
+            break;
+        case 'F':
+            order_book.prefetch_order(ITCH::MsgView<ITCH::AddOrderMpidLayout>(fields).template get<&ITCH::AddOrderMpid::order_reference_number>());
+            break;
+        default:
+            break;
+    }
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::report() const {
+    std::cout << "Instruments: " << order_book.instruments_count() << '\n';
+    std::cout << "Order messages: " << total_messages << '\n';
+    std::cout << "Max live orders: " << order_book.max_orders << '\n';
+
+    if constexpr (requires { order_book.orders_map.pages_in_use(); }) {
+        std::cout << "Order table pages in use: " << order_book.orders_map.pages_in_use()
+                  << ", overflow orders: " << order_book.orders_map.overflow_size() << '\n';
+    }
+
+    std::cout << "Resident memory: " << (resident_bytes() - start_rss) / (1024 * 1024) << "MB\n";
+    if (order_book.instruments_count() != 0) {
+        std::cout << "Level bytes per instrument: "
+                  << order_book.level_bytes() / order_book.instruments_count() << '\n';
+    }
+    print_latency_percentiles(latency_distribution);
+
+    // the messages over the time spent in packets, the gaps between them don't count
+    std::cout << "Order messages per busy second: " << (packet_ns == 0 ? 0 : total_messages * 1'000'000'000 / packet_ns) << '\n';
+    std::cout << "Packet ";
+    print_latency_percentiles(packet_latency_distribution);
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle(const ITCH::SystemEvent& msg) {
+    if (msg.event_code == 'C') { // last message
+        last_message = true;
+        report();
+    }
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle(const ITCH::AddOrderNoMpid& msg) {
+    auto change = order_book.add_order(msg.stock_locate, msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
+    benchmark::DoNotOptimize(change);
+    order_book.max_orders = std::max(order_book.max_orders, order_book.orders_map.size());
+    touched = true;
+    total_messages++;
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle(const ITCH::AddOrderMpid& msg) {
+    auto change = order_book.add_order(msg.stock_locate, msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
+    benchmark::DoNotOptimize(change);
+    order_book.max_orders = std::max(order_book.max_orders, order_book.orders_map.size());
+    touched = true;
+    total_messages++;
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle(const ITCH::OrderExecuted& msg) {
+    auto change = order_book.execute_order(msg.order_reference_number, msg.executed_shares);
+    benchmark::DoNotOptimize(change);
+    touched = true;
+    total_messages++;
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle(const ITCH::OrderExecutedPrice& msg) {
+    auto change = order_book.execute_order(msg.order_reference_number, msg.executed_shares);
+    benchmark::DoNotOptimize(change);
+    touched = true;
+    total_messages++;
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle(const ITCH::OrderCancel& msg) {
+    auto change = order_book.cancel_order(msg.order_reference_number, msg.cancelled_shares);
+    benchmark::DoNotOptimize(change);
+    touched = true;
+    total_messages++;
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle(const ITCH::OrderDelete& msg) {
+    auto change = order_book.delete_order(msg.order_reference_number);
+    benchmark::DoNotOptimize(change);
+    touched = true;
+    total_messages++;
+}
+
+template<typename Book, bool Pipelined>
+inline void BenchmarkMarketOrderBook<Book, Pipelined>::handle(const ITCH::OrderReplace& msg) {
+    auto change = order_book.replace_order(msg.order_reference_number, msg.new_reference_number, msg.shares, msg.price);
+    benchmark::DoNotOptimize(change);
+    touched = true;
+    total_messages++;
+}
+
+// the same full market build with one pre-sized hash table instead of the
+// paged one
+using BenchmarkMarketHashOrderBook = BenchmarkMarketOrderBook<
+    OB::MarketOrderBook<OB::VectorLevelBSearchSplit, OB::HashOrderTable<OB::MarketOrder>>
+>;
+
+// small inline level arrays which grow into the session arena
+using BenchmarkCompactMarketOrderBook = BenchmarkMarketOrderBook<
+    OB::MarketOrderBook<OB::CompactLevels>
+>;
+
+// the default full market build with the order table slots of every packet
+// prefetched ahead, run it with --batch
+using BenchmarkPipelinedMarketOrderBook = BenchmarkMarketOrderBook<OB::MarketOrderBook<>, true>;
@@ -0,0 +1,656 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "adaptive_order_book.hpp"
+#include "handler.hpp"
+#include "ingestor.hpp"
+#include "itch_parser.hpp"
+#include "levels/window_levels.hpp"
+#include "order_book.hpp"
+#include "tick_order_book.hpp"
+
+// Replays of synthetic feeds whose outcome is known, next to the benchmarks
+// which replay the recorded one. --self-check runs them instead of the
+// benchmarks:
+//  - books driven by random order flow against a std::map reference, down to
+//    the order counts of the top levels: the adaptive book from each of its
+//    stores, the window store, and a tick book which meets a price off its
+//    grid halfway through
+//  - the handler fed packets which repeat the tail of the previous one, in
+//    every parse mode, against the same feed without the repeats
+//  - a restore from a checkpoint taken mid feed, followed by the repeating
+//    feed from the start
+//  - a catch-up to a sequence and to a time: nothing is published before the
+//    handover, every book publishes its best levels at it, and the books end
+//    up as the ones of a live replay
+
+// One MoldUDP64 packet, its messages as they are on the wire: a 2 byte length
+// and the ITCH message
+struct SyntheticPacket {
+    uint64_t seq;
+    uint64_t timestamp; // of the first message
+    std::vector<std::vector<std::byte>> messages;
+
+    // the packet payload from message from on
+    std::vector<std::byte> payload(size_t from = 0) const {
+        std::vector<std::byte> out;
+        for (size_t i = from; i < messages.size(); ++i) {
+            out.insert(out.end(), messages[i].begin(), messages[i].end());
+        }
+        return out;
+    }
+};
+
+// Order flow of two instruments around 100$ on a cent grid, the first packet
+// is their stock directory
+class SyntheticFeed {
+public:
+    static constexpr std::array<uint16_t, 2> locates = {7, 9};
+    static constexpr std::array<std::string_view, 2> symbols = {"AAPL", "NVDA"};
+
+    SyntheticFeed(uint64_t seed, size_t packet_count);
+
+    std::vector<SyntheticPacket> packets;
+
+    // the feed as a gap fill or an A/B arbitration may deliver it: the second
+    // half of every packet comes again in front of the next one, which then
+    // also comes again on its own
+    std::vector<SyntheticPacket> with_retransmissions() const;
+
+private:
+    struct LiveOrder {
+        uint64_t id;
+        uint32_t qty;
+        uint32_t price;
+        size_t instrument;
+        char side;
+    };
+
+    void add_message(std::mt19937_64& rng, SyntheticPacket& packet);
+    void begin(char type, size_t instrument);
+    void put(uint64_t value, int bytes);
+    void put_symbol(size_t instrument);
+    void end(SyntheticPacket& packet);
+    void push(SyntheticPacket packet);
+
+    std::vector<LiveOrder> live;
+    std::vector<std::byte> message;
+    uint64_t next_seq = 1;
+    uint64_t timestamp = 34'200'000'000'000; // 9:30
+    uint64_t next_order_id = 1;
+    uint64_t next_match = 1;
+};
+
+inline SyntheticFeed::SyntheticFeed(uint64_t seed, size_t packet_count) {
+    std::mt19937_64 rng(seed);
+
+    SyntheticPacket directory{ .seq = next_seq, .timestamp = timestamp + 1000 };
+    for (size_t instrument = 0; instrument < locates.size(); ++instrument) {
+        begin('R', instrument);
+        put_symbol(instrument);
+        message.resize(message.size() + 20); // categories, lots, flags
+        end(directory);
+    }
+    push(std::move(directory));
+
+    for (size_t p = 0; p < packet_count; ++p) {
+        SyntheticPacket packet{ .seq = next_seq, .timestamp = timestamp + 1000 };
+        size_t count = 1 + rng() % 30;
+        for (size_t i = 0; i < count; ++i) {
+            add_message(rng, packet);
+        }
+        push(std::move(packet));
+    }
+}
+
+inline void SyntheticFeed::add_message(std::mt19937_64& rng, SyntheticPacket& packet) {
+    uint64_t op = rng() % 100;
+    if (live.empty() || op < 40) {
+        LiveOrder order{
+            .id = next_order_id++,
+            .qty = uint32_t(1 + rng() % 500),
+            .instrument = size_t(rng() % 2),
+            .side = rng() % 2 ? 'B' : 'S'
+        };
+        uint32_t ticks = uint32_t(rng() % 40);
+        order.price = order.side == 'B' ? 1'000'000 - 100 * ticks : 1'000'100 + 100 * ticks;
+
+        begin('A', order.instrument);
+        put(order.id, 8);
+        put(uint8_t(order.side), 1);
+        put(order.qty, 4);
+        put_symbol(order.instrument);
+        put(order.price, 4);
+        end(packet);
+        live.push_back(order);
+        return;
+    }
+
+    size_t i = rng() % live.size();
+    LiveOrder& order = live[i];
+    if (op < 60) {
+        begin('D', order.instrument);
+        put(order.id, 8);
+        end(packet);
+        order.qty = 0;
+    } else if (op < 85) {
+        uint32_t qty = uint32_t(1 + rng() % order.qty);
+        if (op < 75) {
+            begin('E', order.instrument);
+            put(order.id, 8);
+            put(qty, 4);
+            put(next_match++, 8);
+        } else {
+            begin('X', order.instrument);
+            put(order.id, 8);
+            put(qty, 4);
+        }
+        end(packet);
+        order.qty -= qty;
+    } else {
+        uint64_t new_id = next_order_id++;
+        uint32_t qty = uint32_t(1 + rng() % 500);
+        uint32_t price = order.price + 100 * uint32_t(rng() % 9) - 400;
+
+        begin('U', order.instrument);
+        put(order.id, 8);
+        put(new_id, 8);
+        put(qty, 4);
+        put(price, 4);
+        end(packet);
+        order.id = new_id;
+        order.qty = qty;
+        order.price = price;
+    }
+
+    if (order.qty == 0) {
+        live[i] = live.back();
+        live.pop_back();
+    }
+}
+
+inline void SyntheticFeed::begin(char type, size_t instrument) {
+    message.clear();
+    put(0, 2); // length, set by end()
+    put(uint8_t(type), 1);
+    put(locates[instrument], 2);
+    put(0, 2); // tracking number
+    timestamp += 1000;
+    put(timestamp, 6);
+}
+
+inline void SyntheticFeed::put(uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        message.push_back(std::byte(value >> (8 * i)));
+    }
+}
+
+inline void SyntheticFeed::put_symbol(size_t instrument) {
+    std::string_view symbol = symbols[instrument];
+    for (size_t i = 0; i < 8; ++i) {
+        message.push_back(std::byte(i < symbol.size() ? symbol[i] : ' '));
+    }
+}
+
+inline void SyntheticFeed::end(SyntheticPacket& packet) {
+    uint16_t length = uint16_t(message.size() - 2);
+    message[0] = std::byte(length >> 8);
+    message[1] = std::byte(length);
+    packet.messages.push_back(message);
+}
+
+inline void SyntheticFeed::push(SyntheticPacket packet) {
+    next_seq += packet.messages.size();
+    packets.push_back(std::move(packet));
+}
+
+inline std::vector<SyntheticPacket> SyntheticFeed::with_retransmissions() const {
+    std::vector<SyntheticPacket> out;
+    for (size_t i = 0; i < packets.size(); ++i) {
+        if (i > 0 && packets[i - 1].messages.size() > 1) {
+            const SyntheticPacket& previous = packets[i - 1];
+            size_t half = previous.messages.size() / 2;
+            SyntheticPacket merged{ .seq = previous.seq + half, .timestamp = previous.timestamp };
+            merged.messages.assign(previous.messages.begin() + half, previous.messages.end());
+            merged.messages.insert(merged.messages.end(), packets[i].messages.begin(), packets[i].messages.end());
+            out.push_back(std::move(merged));
+        }
+        out.push_back(packets[i]);
+    }
+    return out;
+}
+
+// A handler on the synthetic instruments which keeps the best level updates
+// it publishes. Heap only, the queues are 8MB each
+struct ReplayTarget {
+    std::array<Handler::Queue, 2> queues;
+    std::array<Handler::Queue::Consumer, 2> consumers{queues[0].make_consumer(), queues[1].make_consumer()};
+    std::unique_ptr<Handler> handler;
+    std::unique_ptr<ITCH::ItchParser> parser = std::make_unique<ITCH::ItchParser>();
+    std::array<std::vector<BookUpdateMsg>, 2> updates;
+
+    ReplayTarget() {
+        std::vector<Handler::InstrumentConfig> config;
+        for (size_t i = 0; i < queues.size(); ++i) {
+            config.push_back({ .symbol = std::string(SyntheticFeed::symbols[i]), .queue = &queues[i] });
+        }
+        handler = std::make_unique<Handler>(config);
+    }
+
+    // one packet through the ingestor path, the catch-up one while it lasts
+    void replay(const SyntheticPacket& packet, ITCH::ParseMode mode) {
+        std::vector<std::byte> payload = packet.payload();
+        uint16_t count = uint16_t(packet.messages.size());
+        if (handler->catching_up()) {
+            ITCH::parse_packet(*parser, handler->catch_up, payload.data(), payload.size(), packet.seq, count, mode);
+        } else {
+            ITCH::parse_packet(*parser, *handler, payload.data(), payload.size(), packet.seq, count, mode);
+        }
+    }
+
+    // moves the published best level updates to updates, without their t0
+    size_t drain() {
+        size_t popped = 0;
+        for (size_t i = 0; i < consumers.size(); ++i) {
+            StrategyMsg msg;
+            while (consumers[i].pop(msg)) {
+                if (msg.type == StrategyMsgType::BookUpdate) {
+                    msg.book_update.t0 = 0;
+                    updates[i].push_back(msg.book_update);
+                    popped++;
+                }
+            }
+        }
+        return popped;
+    }
+
+    const Handler::Book* book(size_t instrument) const {
+        return handler->book(SyntheticFeed::locates[instrument]);
+    }
+};
+
+inline bool same_update(const BookUpdateMsg& a, const BookUpdateMsg& b) {
+    return a.qty == b.qty && a.price == b.price && a.side == b.side;
+}
+
+// the books of both instruments, compared as deep as they go here
+inline std::string compare_books(const ReplayTarget& got, const ReplayTarget& want) {
+    for (size_t i = 0; i < SyntheticFeed::symbols.size(); ++i) {
+        std::string symbol(SyntheticFeed::symbols[i]);
+        const Handler::Book* a = got.book(i);
+        const Handler::Book* b = want.book(i);
+        if (a == nullptr || b == nullptr) {
+            return "no " + symbol + " book";
+        }
+        if (!(a->depth<64>() == b->depth<64>())) {
+            return symbol + " levels differ";
+        }
+        if (a->orders_map.size() != b->orders_map.size()) {
+            return symbol + " has " + std::to_string(a->orders_map.size()) + " orders instead of "
+                + std::to_string(b->orders_map.size());
+        }
+    }
+    return {};
+}
+
+// Every level of a book with the qty and the number of orders resting there
+struct ReferenceBook {
+    struct Level {
+        uint64_t qty = 0;
+        uint32_t orders = 0;
+    };
+
+    std::map<uint32_t, Level> bids;
+    std::map<uint32_t, Level> asks;
+
+    void add(OB::Side side, uint32_t price, uint32_t qty) {
+        Level& level = levels(side)[price];
+        level.qty += qty;
+        level.orders++;
+    }
+
+    // left is set when the order is gone from the level
+    void remove(OB::Side side, uint32_t price, uint32_t qty, bool left) {
+        Level& level = levels(side)[price];
+        level.qty -= qty;
+        level.orders -= left;
+        if (level.qty == 0) {
+            levels(side).erase(price);
+        }
+    }
+
+    template<size_t N>
+    OB::DepthSide<N> top(OB::Side side) const {
+        OB::DepthSide<N> out;
+        auto fill = [&](auto it, auto end) {
+            for (; it != end && out.count < N; ++it, ++out.count) {
+                out.qtys[out.count] = it->second.qty;
+                out.prices[out.count] = it->first;
+                out.orders[out.count] = it->second.orders;
+            }
+        };
+        if (side == OB::Side::Bid) {
+            fill(bids.rbegin(), bids.rend());
+        } else {
+            fill(asks.begin(), asks.end());
+        }
+        return out;
+    }
+
+    std::map<uint32_t, Level>& levels(OB::Side side) {
+        return side == OB::Side::Bid ? bids : asks;
+    }
+};
+
+// Random adds, cancels, executions, deletes and replaces on book and on the
+// reference. After every operation the best levels and the best level change
+// are checked, the top 8 levels with their order counts every 4th. Prices are
+// on a grid of tick until off_grid_from
+template<typename Book>
+std::string check_book(Book& book, uint64_t seed, size_t ops, uint32_t tick = 1, size_t off_grid_from = SIZE_MAX) {
+    struct RefOrder {
+        uint32_t qty;
+        uint32_t price;
+        OB::Side side;
+    };
+
+    std::mt19937_64 rng(seed);
+    ReferenceBook reference;
+    std::unordered_map<uint64_t, RefOrder> orders;
+    std::vector<uint64_t> ids;
+    uint64_t next_id = 1;
+    constexpr uint32_t low = 1'000'000;
+    constexpr uint32_t high = 1'400'000;
+    uint32_t mid = (low + high) / 2;
+
+    auto snap = [&](int64_t price, size_t op) {
+        uint32_t p = uint32_t(std::clamp<int64_t>(price, low, high - 1));
+        return op < off_grid_from ? p - p % tick : p;
+    };
+
+    for (size_t op = 0; op < ops; ++op) {
+        OB::DepthSide<1> bid_before = reference.top<1>(OB::Side::Bid);
+        OB::DepthSide<1> ask_before = reference.top<1>(OB::Side::Ask);
+        OB::BestLvlChange change{};
+        OB::Side side;
+
+        uint64_t kind = rng() % 100;
+        if (ids.empty() || (kind < 55 && orders.size() < 3000)) {
+            side = rng() % 2 ? OB::Side::Bid : OB::Side::Ask;
+            if (rng() % 1000 == 0) {
+                mid = low + uint32_t(rng() % (high - low));
+            }
+            // mostly around the mid, now and then anywhere
+            int64_t distance = int64_t(rng() % 200);
+            int64_t price = rng() % 10 == 0 ? low + int64_t(rng() % (high - low))
+                : side == OB::Side::Bid ? mid - distance : mid + distance;
+            RefOrder order{ .qty = uint32_t(1 + rng() % 500), .price = snap(price, op), .side = side };
+            uint64_t id = next_id += 1 + rng() % 3;
+
+            change = book.add_order(id, side, order.qty, order.price);
+            reference.add(side, order.price, order.qty);
+            orders.emplace(id, order);
+            ids.push_back(id);
+        } else {
+            size_t i = rng() % ids.size();
+            uint64_t id = ids[i];
+            RefOrder& order = orders[id];
+            side = order.side;
+
+            if (kind < 70) {
+                change = book.delete_order(id);
+                reference.remove(side, order.price, order.qty, true);
+                order.qty = 0;
+            } else if (kind < 90) {
+                uint32_t qty = uint32_t(1 + rng() % order.qty);
+                change = kind < 80 ? book.cancel_order(id, qty) : book.execute_order(id, qty);
+                reference.remove(side, order.price, qty, qty == order.qty);
+                order.qty -= qty;
+            } else {
+                uint64_t new_id = next_id += 1 + rng() % 3;
+                RefOrder replaced{
+                    .qty = uint32_t(1 + rng() % 500),
+                    .price = snap(int64_t(order.price) + int64_t(rng() % 21) - 10, op),
+                    .side = side
+                };
+
+                change = book.replace_order(id, new_id, replaced.qty, replaced.price);
+                reference.remove(side, order.price, order.qty, true);
+                reference.add(side, replaced.price, replaced.qty);
+                orders.emplace(new_id, replaced);
+                ids.push_back(new_id);
+                order.qty = 0;
+            }
+
+            if (order.qty == 0) {
+                orders.erase(id);
+                ids[i] = ids.back();
+                ids.pop_back();
+            }
+        }
+
+        if (op % 5000 == 4999) {
+            book.idle();
+        }
+
+        std::string at = "op " + std::to_string(op) + ": ";
+        OB::DepthSide<1> bid = reference.top<1>(OB::Side::Bid);
+        OB::DepthSide<1> ask = reference.top<1>(OB::Side::Ask);
+        OB::Level best_bid = book.best_bid();
+        OB::Level best_ask = book.best_ask();
+        if (best_bid.qty != bid.qtys[0] || (bid.count != 0 && best_bid.price != bid.prices[0])) {
+            return at + "best bid " + std::to_string(best_bid.qty) + "@" + std::to_string(best_bid.price)
+                + " instead of " + std::to_string(bid.qtys[0]) + "@" + std::to_string(bid.prices[0]);
+        }
+        if (best_ask.qty != ask.qtys[0] || (ask.count != 0 && best_ask.price != ask.prices[0])) {
+            return at + "best ask " + std::to_string(best_ask.qty) + "@" + std::to_string(best_ask.price)
+                + " instead of " + std::to_string(ask.qtys[0]) + "@" + std::to_string(ask.prices[0]);
+        }
+
+        const OB::DepthSide<1>& now = side == OB::Side::Bid ? bid : ask;
+        const OB::DepthSide<1>& before = side == OB::Side::Bid ? bid_before : ask_before;
+        bool moved = now.qtys[0] != before.qtys[0] || now.prices[0] != before.prices[0];
+        if (moved && change.side != side) {
+            return at + "best level moved without a change";
+        }
+        if (change.side != OB::Side::None
+            && (change.side != side || change.qty != now.qtys[0] || (now.count != 0 && change.price != now.prices[0]))) {
+            return at + "the change is not the new best level";
+        }
+
+        if (book.orders_map.size() != orders.size()) {
+            return at + std::to_string(book.orders_map.size()) + " orders instead of " + std::to_string(orders.size());
+        }
+
+        if (op % 4 == 0) {
+            OB::DepthSnapshot<8> depth = book.template depth<8>();
+            if (!(depth.bid == reference.top<8>(OB::Side::Bid)) || !(depth.ask == reference.top<8>(OB::Side::Ask))) {
+                return at + "top 8 levels differ";
+            }
+        }
+    }
+    return {};
+}
+
+inline bool report_check(std::string_view name, const std::string& failure) {
+    std::cout << name << ": " << (failure.empty() ? "ok" : "FAILED, " + failure) << '\n';
+    return failure.empty();
+}
+
+inline bool run_book_checks() {
+    bool ok = true;
+    constexpr size_t ops = 200'000;
+
+    constexpr std::array<std::pair<OB::LevelStore, std::string_view>, 3> stores = {{
+        { OB::LevelStore::Split, "adaptive book from the split store" },
+        { OB::LevelStore::Window, "adaptive book from the window store" },
+        { OB::LevelStore::Eytzinger, "adaptive book from the eytzinger store" }
+    }};
+    for (const auto& [store, name] : stores) {
+        auto book = std::make_unique<OB::AdaptiveOrderBook<>>(store);
+        ok &= report_check(name, check_book(*book, 3, ops));
+    }
+
+    {
+        auto book = std::make_unique<OB::OrderBook<OB::WindowLevels>>();
+        ok &= report_check("window book", check_book(*book, 4, ops));
+    }
+
+    {
+        // the handler book on a cent grid until the feed leaves it
+        auto book = std::make_unique<Handler::Book>(OB::PriceCodec(100));
+        std::string failure = check_book(*book, 6, ops, 100, ops / 2);
+        if (failure.empty() && book->codec_fallbacks != 1) {
+            failure = std::to_string(book->codec_fallbacks) + " codec fallbacks instead of 1";
+        }
+        ok &= report_check("tick book leaving its grid", failure);
+    }
+    return ok;
+}
+
+// the repeated messages are dropped whatever the parse mode, the books and
+// the published updates are those of the feed without them
+inline std::string check_retransmissions(const SyntheticFeed& feed, ITCH::ParseMode mode) {
+    auto clean = std::make_unique<ReplayTarget>();
+    for (const SyntheticPacket& packet : feed.packets) {
+        clean->replay(packet, mode);
+        clean->drain();
+    }
+
+    auto repeated = std::make_unique<ReplayTarget>();
+    for (const SyntheticPacket& packet : feed.with_retransmissions()) {
+        repeated->replay(packet, mode);
+        repeated->drain();
+    }
+
+    if (std::string failure = compare_books(*repeated, *clean); !failure.empty()) {
+        return failure;
+    }
+    for (size_t i = 0; i < clean->updates.size(); ++i) {
+        const auto& got = repeated->updates[i];
+        const auto& want = clean->updates[i];
+        if (got.size() != want.size() || !std::equal(got.begin(), got.end(), want.begin(), same_update)) {
+            return std::string(SyntheticFeed::symbols[i]) + " published " + std::to_string(got.size())
+                + " updates instead of " + std::to_string(want.size()) + " or others";
+        }
+    }
+    return {};
+}
+
+// a checkpoint taken at every packet end until cut, then restored into a new
+// handler which gets the whole feed with repeats: the packets the checkpoint
+// covers are dropped, the one straddling it is applied from where it left off
+inline std::string check_restore(const SyntheticFeed& feed, const std::string& path, size_t cut) {
+    std::remove(path.c_str());
+    {
+        auto writer = std::make_unique<ReplayTarget>();
+        writer->handler->enable_checkpoints(path, std::chrono::milliseconds(0));
+        for (size_t i = 0; i < cut; ++i) {
+            writer->replay(feed.packets[i], ITCH::ParseMode::Sequential);
+            writer->drain();
+        }
+        ITCH::SystemEvent end{};
+        end.event_code = 'C';
+        writer->handler->handle(end);
+    }
+
+    auto reference = std::make_unique<ReplayTarget>();
+    for (const SyntheticPacket& packet : feed.packets) {
+        reference->replay(packet, ITCH::ParseMode::Sequential);
+        reference->drain();
+    }
+
+    auto restored = std::make_unique<ReplayTarget>();
+    if (!restored->handler->restore(path)) {
+        return "no checkpoint in " + path;
+    }
+    for (const SyntheticPacket& packet : feed.with_retransmissions()) {
+        restored->replay(packet, ITCH::ParseMode::Sequential);
+        restored->drain();
+    }
+    std::remove(path.c_str());
+    return compare_books(*restored, *reference);
+}
+
+// nothing is published until the packet which reaches the target, at its end
+// every book publishes its best bid and ask, and from then on the handler is
+// live with the books of a handler which was live all along
+inline std::string check_catch_up(const SyntheticFeed& feed, uint64_t target_seq, uint64_t target_timestamp) {
+    auto reference = std::make_unique<ReplayTarget>();
+    for (const SyntheticPacket& packet : feed.packets) {
+        reference->replay(packet, ITCH::ParseMode::Sequential);
+        reference->drain();
+    }
+
+    auto target = std::make_unique<ReplayTarget>();
+    target->handler->start_catch_up(target_seq, target_timestamp);
+    bool handed_over = false;
+    for (const SyntheticPacket& packet : feed.with_retransmissions()) {
+        bool catching_up = target->handler->catching_up();
+        target->replay(packet, ITCH::ParseMode::Sequential);
+        size_t popped = target->drain();
+        if (!catching_up) {
+            continue;
+        }
+        if (target->handler->catching_up()) {
+            if (popped != 0) {
+                return "published while catching up at sequence " + std::to_string(packet.seq);
+            }
+            continue;
+        }
+
+        handed_over = true;
+        if (popped != 2 * SyntheticFeed::symbols.size()) {
+            return std::to_string(popped) + " updates at the handover";
+        }
+        for (size_t i = 0; i < target->updates.size(); ++i) {
+            OB::DepthSnapshot<1> top = target->book(i)->depth<1>();
+            BookUpdateMsg bid{ .qty = top.bid.qtys[0], .price = top.bid.prices[0], .side = OB::Side::Bid };
+            BookUpdateMsg ask{ .qty = top.ask.qtys[0], .price = top.ask.prices[0], .side = OB::Side::Ask };
+            const auto& updates = target->updates[i];
+            if (updates.size() != 2 || !same_update(updates[0], bid) || !same_update(updates[1], ask)) {
+                return std::string(SyntheticFeed::symbols[i]) + " did not publish its best levels at the handover";
+            }
+        }
+    }
+
+    if (!handed_over) {
+        return "never handed over";
+    }
+    return compare_books(*target, *reference);
+}
+
+// dir takes the checkpoint of the restore check
+inline bool run_replay_checks(const std::string& dir) {
+    bool ok = run_book_checks();
+
+    SyntheticFeed feed(42, 3000);
+    constexpr std::array<std::pair<ITCH::ParseMode, std::string_view>, 3> modes = {{
+        { ITCH::ParseMode::Sequential, "retransmissions, sequential parse" },
+        { ITCH::ParseMode::Batched, "retransmissions, batched parse" },
+        { ITCH::ParseMode::BatchedByType, "retransmissions, batched parse by type" }
+    }};
+    for (const auto& [mode, name] : modes) {
+        ok &= report_check(name, check_retransmissions(feed, mode));
+    }
+
+    ok &= report_check("restore from a checkpoint", check_restore(feed, dir + "/replay_check.ckp", 1700));
+
+    const SyntheticPacket& target = feed.packets[1200];
+    ok &= report_check("catch-up to a sequence", check_catch_up(feed, target.seq + 2, 0));
+    ok &= report_check("catch-up to a time", check_catch_up(feed, 0, target.timestamp + 1));
+    return ok;
+}
@@ -0,0 +1,208 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "depth_snapshot.hpp"
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+// trivial, it travels in the StrategyMsg union
+struct AnalyticsSnapshot {
+    double microprice;    // ITCH price units, 0 while a side is empty
+    uint64_t bid_depth;   // qty within the band of the best bid
+    uint64_t ask_depth;
+    float imbalance;      // (bid - ask) / (bid + ask) over the top N levels
+    float arrival_rate;   // orders joining a level, per second
+    float departure_rate; // orders leaving a level (cancel, delete, full fill), per second
+
+    bool operator==(const AnalyticsSnapshot&) const = default;
+};
+
+// Events over a rolling window, kept in Buckets buckets so that adding an
+// event or reading the rate is O(Buckets) at worst and O(1) while the time
+// stays in the current bucket.
+template<size_t Buckets = 16>
+class RollingCounter {
+public:
+    explicit RollingCounter(uint64_t window_ns) : bucket_ns(std::max<uint64_t>(window_ns / Buckets, 1)) {}
+
+    void add(uint64_t now_ns) {
+        advance(now_ns);
+        counts[current]++;
+        total++;
+    }
+
+    float per_second(uint64_t now_ns) {
+        advance(now_ns);
+        return float(total) * 1e9f / float(bucket_ns * Buckets);
+    }
+
+private:
+    void advance(uint64_t now_ns) {
+        uint64_t bucket = now_ns / bucket_ns;
+        if (bucket <= current_bucket) {
+            return;
+        }
+
+        uint64_t steps = std::min<uint64_t>(bucket - current_bucket, Buckets);
+        for (uint64_t i = 0; i < steps; ++i) {
+            current = current + 1 < Buckets ? current + 1 : 0;
+            total -= counts[current];
+            counts[current] = 0;
+        }
+        current_bucket = bucket;
+    }
+
+    std::array<uint64_t, Buckets> counts{};
+    uint64_t total = 0;
+    uint64_t bucket_ns;
+    uint64_t current_bucket = 0;
+    size_t current = 0;
+};
+
+// Microstructure measures of one book kept up to date from its level deltas:
+// microprice, top N imbalance, the qty within band of each best price and the
+// order arrival and departure rates over a rolling window.
+//
+// Every side keeps a copy of its best K levels. A delta for a level beyond the
+// copy is dropped and a delta for a level in it updates the cached qty, which
+// is a scan of K prices. Only when a level inside the copy is created or
+// emptied is the side copied again from the book, which can be the order book
+// itself or an L2Replica on another core fed by the published deltas. The
+// band depth counts the cached levels only, K bounds how wide a band makes
+// sense.
+template<size_t N = 5, size_t K = 16>
+class BookAnalytics {
+    static_assert(N <= K);
+
+public:
+    // band in ITCH price units, 1000 is 10 cents
+    explicit BookAnalytics(uint32_t band = 1000, uint64_t rate_window_ns = 1'000'000'000)
+        : band(band), arrivals(rate_window_ns), departures(rate_window_ns) {}
+
+    // the deltas of one book operation, applied after the book has them
+    template<typename Book>
+    void apply(const LevelDelta* deltas, size_t count, const Book& book, uint64_t now_ns);
+
+    AnalyticsSnapshot snapshot(uint64_t now_ns);
+
+    // copies both sides from the book again, for a book which changed without
+    // its deltas being applied (a catch-up). The rates keep their windows
+    template<typename Book>
+    void resync(const Book& book) {
+        DepthSnapshot<K> fresh = book.template depth<K>();
+        bid = fresh.bid;
+        ask = fresh.ask;
+    }
+
+private:
+    template<Side S>
+    static bool at_or_better(uint32_t price, uint32_t than) {
+        return S == Side::Bid ? price >= than : price <= than;
+    }
+
+    template<Side S>
+    static bool update_cached(DepthSide<K>& side, const LevelDelta& delta);
+
+    static uint64_t within(const DepthSide<K>& side, uint32_t band, bool bid);
+
+    uint32_t band;
+    RollingCounter<> arrivals;
+    RollingCounter<> departures;
+
+    DepthSide<K> bid;
+    DepthSide<K> ask;
+};
+
+// false when the delta changed which levels the copy holds
+template<size_t N, size_t K>
+template<Side S>
+inline bool BookAnalytics<N, K>::update_cached(DepthSide<K>& side, const LevelDelta& delta) {
+    if (side.count == K && !at_or_better<S>(delta.price, side.prices[K - 1])) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < side.count; ++i) {
+        if (side.prices[i] == delta.price) {
+            side.qtys[i] += uint64_t(delta.qty);
+            return side.qtys[i] != 0;
+        }
+    }
+
+    return false;
+}
+
+template<size_t N, size_t K>
+template<typename Book>
+inline void BookAnalytics<N, K>::apply(const LevelDelta* deltas, size_t count, const Book& book, uint64_t now_ns) {
+    bool stale[2] = {false, false};
+
+    for (size_t i = 0; i < count; ++i) {
+        const LevelDelta& delta = deltas[i];
+        if (delta.orders > 0) {
+            arrivals.add(now_ns);
+        } else if (delta.orders < 0) {
+            departures.add(now_ns);
+        }
+
+        if (delta.side == Side::Bid) {
+            stale[0] |= !update_cached<Side::Bid>(bid, delta);
+        } else {
+            stale[1] |= !update_cached<Side::Ask>(ask, delta);
+        }
+    }
+
+    if (stale[0] || stale[1]) [[unlikely]] {
+        DepthSnapshot<K> fresh = book.template depth<K>();
+        if (stale[0]) {
+            bid = fresh.bid;
+        }
+        if (stale[1]) {
+            ask = fresh.ask;
+        }
+    }
+}
+
+template<size_t N, size_t K>
+inline uint64_t BookAnalytics<N, K>::within(const DepthSide<K>& side, uint32_t band, bool is_bid) {
+    uint64_t qty = 0;
+    for (uint32_t i = 0; i < side.count; ++i) {
+        uint32_t distance = is_bid ? side.prices[0] - side.prices[i] : side.prices[i] - side.prices[0];
+        if (distance > band) {
+            break;
+        }
+        qty += side.qtys[i];
+    }
+    return qty;
+}
+
+template<size_t N, size_t K>
+inline AnalyticsSnapshot BookAnalytics<N, K>::snapshot(uint64_t now_ns) {
+    AnalyticsSnapshot s{};
+
+    if (bid.count != 0 && ask.count != 0) {
+        double bid_qty = double(bid.qtys[0]);
+        double ask_qty = double(ask.qtys[0]);
+        s.microprice = (bid.prices[0] * ask_qty + ask.prices[0] * bid_qty) / (bid_qty + ask_qty);
+    }
+
+    uint64_t bid_top = 0;
+    uint64_t ask_top = 0;
+    for (size_t i = 0; i < N; ++i) {
+        bid_top += bid.qtys[i];
+        ask_top += ask.qtys[i];
+    }
+    if (bid_top + ask_top != 0) {
+        s.imbalance = float(double(int64_t(bid_top) - int64_t(ask_top)) / double(bid_top + ask_top));
+    }
+
+    s.bid_depth = within(bid, band, true);
+    s.ask_depth = within(ask, band, false);
+    s.arrival_rate = arrivals.per_second(now_ns);
+    s.departure_rate = departures.per_second(now_ns);
+    return s;
+}
+
+}
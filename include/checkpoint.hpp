@@ -0,0 +1,322 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <absl/container/flat_hash_map.h>
+#include <emmintrin.h>
+#include "order_book_shared.hpp"
+#include "spsc_queue.hpp"
+
+// Binary checkpoint of the handler state: the instruments with a book, by
+// locate and symbol, every live order and the MoldUDP64 sequence of the first
+// message the checkpoint doesn't cover. The level stores are not written,
+// they are rebuilt from the orders on restore.
+//
+//   CheckpointHeader
+//   CheckpointInstrument[instruments]
+//   CheckpointOrder[orders]
+struct CheckpointHeader {
+    char magic[8];
+    uint64_t next_seq;
+    uint64_t instruments;
+    uint64_t orders;
+};
+
+struct CheckpointInstrument {
+    char symbol[8];
+    uint16_t locate;
+};
+
+struct CheckpointOrder {
+    uint64_t order_id;
+    uint32_t qty;
+    uint32_t price;
+    uint16_t locate;
+    OB::Side side;
+};
+
+inline constexpr char checkpoint_magic[8] = {'I', 'T', 'C', 'H', 'C', 'K', 'P', '1'};
+
+struct CheckpointImage {
+    CheckpointHeader header;
+    std::vector<CheckpointInstrument> instruments;
+    std::vector<CheckpointOrder> orders;
+};
+
+inline bool read_checkpoint(const std::string& path, CheckpointImage& image) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        return false;
+    }
+
+    bool ok = std::fread(&image.header, sizeof(image.header), 1, f) == 1
+        && std::memcmp(image.header.magic, checkpoint_magic, sizeof(checkpoint_magic)) == 0;
+    if (ok) {
+        image.instruments.resize(image.header.instruments);
+        image.orders.resize(image.header.orders);
+        ok = std::fread(image.instruments.data(), sizeof(CheckpointInstrument), image.instruments.size(), f) == image.instruments.size()
+            && std::fread(image.orders.data(), sizeof(CheckpointOrder), image.orders.size(), f) == image.orders.size();
+    }
+
+    std::fclose(f);
+    return ok;
+}
+
+enum class CheckpointOpType : uint8_t {
+    Instrument,
+    Add,
+    Reduce,
+    Delete,
+    Replace,
+    PacketEnd,
+    Stop
+};
+
+// what the handler did to its books, in the order it did it. other is the new
+// order id of a replace, the next sequence of a packet end and the symbol of
+// an instrument.
+struct CheckpointOp {
+    uint64_t order_id;
+    uint64_t other;
+    uint32_t qty;
+    uint32_t price;
+    uint16_t locate;
+    CheckpointOpType type;
+    OB::Side side;
+};
+
+static_assert(sizeof(CheckpointOp) == 32);
+
+// Writes checkpoints without stopping ingest. The handler journals every book
+// operation into an SPSC queue, and a background thread replays the journal
+// into a shadow order table, the second copy of the state. At the first packet
+// end after the interval the shadow is serialized into a buffer, still on the
+// background thread, and a second thread writes the buffer to a temporary file
+// and renames it over the checkpoint, so the file on disk is always complete.
+// A checkpoint which comes due while the previous one is still being written
+// is skipped, the shadow keeps up with the journal in the meantime.
+//
+// The ingest side only pays for the push, it spins when the queue is full.
+class CheckpointWriter {
+public:
+    CheckpointWriter(std::string path, std::chrono::milliseconds interval)
+        : path(std::move(path)), interval(interval),
+          applier([this] { apply_loop(); }),
+          file_writer([this] { file_loop(); }) {}
+
+    ~CheckpointWriter() {
+        stop();
+    }
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    void push(const CheckpointOp& op) {
+        while (!ops.try_push(op)) [[unlikely]] {
+            stalls++;
+            _mm_pause();
+        }
+    }
+
+    void stop() {
+        if (applier.joinable()) {
+            push({ .type = CheckpointOpType::Stop });
+            applier.join();
+            file_writer.join();
+        }
+    }
+
+    // ingest side, pushes which found the queue full
+    uint64_t stalls = 0;
+
+    std::atomic<uint64_t> written = 0;
+    std::atomic<uint64_t> skipped = 0;
+
+private:
+    struct ShadowOrder {
+        uint32_t qty;
+        uint32_t price;
+        uint16_t locate;
+        OB::Side side;
+    };
+
+    // buffer states
+    static constexpr int empty = 0;
+    static constexpr int full = 1;
+    static constexpr int stopping = 2;
+
+    // an empty journal is polled that many times before the applier sleeps,
+    // the sleep is far shorter than the time ingest takes to fill the queue
+    static constexpr uint32_t idle_spins = 1024;
+    static constexpr std::chrono::microseconds idle_sleep{50};
+
+    void apply_loop();
+    void apply(const CheckpointOp& op);
+    void serialize(std::vector<std::byte>& out, uint64_t next_seq) const;
+    void file_loop();
+
+    std::string path;
+    std::chrono::milliseconds interval;
+
+    SPSCQueue<CheckpointOp> ops;
+
+    // background thread only
+    absl::flat_hash_map<uint64_t, ShadowOrder> orders;
+    std::vector<CheckpointInstrument> instruments;
+
+    // owned by the file thread while full
+    std::vector<std::byte> buffer;
+    std::atomic<int> buffer_state = empty;
+
+    std::thread applier;
+    std::thread file_writer;
+};
+
+inline void CheckpointWriter::apply(const CheckpointOp& op) {
+    switch (op.type) {
+        case CheckpointOpType::Instrument: {
+            CheckpointInstrument instrument{};
+            std::memcpy(instrument.symbol, &op.other, sizeof(instrument.symbol));
+            instrument.locate = op.locate;
+            instruments.push_back(instrument);
+            break;
+        }
+        case CheckpointOpType::Add:
+            orders[op.order_id] = {op.qty, op.price, op.locate, op.side};
+            break;
+        case CheckpointOpType::Reduce: {
+            auto it = orders.find(op.order_id);
+            if (it != orders.end() && (it->second.qty -= op.qty) == 0) {
+                orders.erase(it);
+            }
+            break;
+        }
+        case CheckpointOpType::Delete:
+            orders.erase(op.order_id);
+            break;
+        case CheckpointOpType::Replace: {
+            auto it = orders.find(op.order_id);
+            if (it != orders.end()) {
+                ShadowOrder order = it->second;
+                orders.erase(it);
+                order.qty = op.qty;
+                order.price = op.price;
+                orders[op.other] = order;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+inline void CheckpointWriter::serialize(std::vector<std::byte>& out, uint64_t next_seq) const {
+    CheckpointHeader header;
+    std::memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+    header.next_seq = next_seq;
+    header.instruments = instruments.size();
+    header.orders = orders.size();
+
+    out.resize(sizeof(header) + instruments.size() * sizeof(CheckpointInstrument) + orders.size() * sizeof(CheckpointOrder));
+    std::byte* p = out.data();
+    std::memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    std::memcpy(p, instruments.data(), instruments.size() * sizeof(CheckpointInstrument));
+    p += instruments.size() * sizeof(CheckpointInstrument);
+
+    for (const auto& [order_id, order] : orders) {
+        CheckpointOrder record;
+        std::memset(&record, 0, sizeof(record)); // no stray padding in the file
+        record.order_id = order_id;
+        record.qty = order.qty;
+        record.price = order.price;
+        record.locate = order.locate;
+        record.side = order.side;
+        std::memcpy(p, &record, sizeof(record));
+        p += sizeof(record);
+    }
+}
+
+inline void CheckpointWriter::apply_loop() {
+    auto last = std::chrono::steady_clock::now();
+
+    uint32_t empty_polls = 0;
+
+    while (true) {
+        CheckpointOp op;
+        if (!ops.try_pop(op)) {
+            // outside market hours the journal stays empty for hours, the
+            // thread gives its core back instead of spinning through them
+            if (++empty_polls < idle_spins) {
+                _mm_pause();
+            } else {
+                std::this_thread::sleep_for(idle_sleep);
+            }
+            continue;
+        }
+        empty_polls = 0;
+
+        if (op.type == CheckpointOpType::Stop) {
+            break;
+        }
+
+        if (op.type != CheckpointOpType::PacketEnd) {
+            apply(op);
+            continue;
+        }
+
+        // a packet end is a consistent point, the packet is either fully in the
+        // shadow or not at all
+        auto now = std::chrono::steady_clock::now();
+        if (now - last < interval) {
+            continue;
+        }
+        last = now;
+
+        if (buffer_state.load(std::memory_order_acquire) != empty) {
+            skipped++;
+            continue;
+        }
+
+        serialize(buffer, op.other);
+        buffer_state.store(full, std::memory_order_release);
+        buffer_state.notify_one();
+    }
+
+    // let a write in flight finish
+    while (buffer_state.load(std::memory_order_acquire) != empty) {
+        buffer_state.wait(full, std::memory_order_acquire);
+    }
+    buffer_state.store(stopping, std::memory_order_release);
+    buffer_state.notify_one();
+}
+
+inline void CheckpointWriter::file_loop() {
+    const std::string tmp = path + ".tmp";
+
+    while (true) {
+        buffer_state.wait(empty, std::memory_order_acquire);
+        if (buffer_state.load(std::memory_order_acquire) == stopping) {
+            return;
+        }
+
+        FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (f != nullptr) {
+            bool ok = std::fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size();
+            ok = std::fflush(f) == 0 && ::fsync(fileno(f)) == 0 && ok;
+            ok = std::fclose(f) == 0 && ok;
+            if (ok && std::rename(tmp.c_str(), path.c_str()) == 0) {
+                written++;
+            }
+        }
+
+        buffer_state.store(empty, std::memory_order_release);
+        buffer_state.notify_one();
+    }
+}
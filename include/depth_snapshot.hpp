@@ -0,0 +1,99 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+// Top N levels of one side, best price first. Kept as a structure of arrays
+// so a consumer summing the qtys or walking the prices reads one contiguous
+// array. The slots past count are zero, which lets two snapshots be compared
+// as a whole. orders stays zero when the level store doesn't count the orders
+// resting on its levels.
+template<size_t N>
+struct DepthSide {
+    uint64_t qtys[N]{};
+    uint32_t prices[N]{};
+    uint32_t orders[N]{};
+    uint32_t count = 0;
+
+    bool operator==(const DepthSide&) const = default;
+};
+
+template<size_t N>
+struct DepthSnapshot {
+    DepthSide<N> bid;
+    DepthSide<N> ask;
+
+    bool operator==(const DepthSnapshot&) const = default;
+};
+
+// copies src[n - 1], ..., src[0] to dst[0], ..., dst[n - 1]. The sorted stores
+// keep the best price at the back, a snapshot wants it at the front.
+inline void copy_reversed(uint32_t* dst, const uint32_t* src, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n - i - 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permutevar8x32_epi32(v, reverse));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = src[n - 1 - i];
+    }
+}
+
+inline void copy_reversed(uint64_t* dst, const uint64_t* src, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n - i - 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permute4x64_epi64(v, 0x1B));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = src[n - 1 - i];
+    }
+}
+
+// Every level store which can back an OrderBook provides
+//     size_t copy_top(size_t n, uint64_t* qtys, uint32_t* prices, uint32_t* orders) const
+// which writes its best min(n, size) levels, best first, and returns how many
+// it wrote.
+template<size_t N, typename Levels>
+inline void fill_depth(const Levels& levels, DepthSide<N>& side) {
+    side.count = uint32_t(levels.copy_top(N, side.qtys, side.prices, side.orders));
+    std::fill(side.qtys + side.count, side.qtys + N, 0);
+    std::fill(side.prices + side.count, side.prices + N, 0);
+    std::fill(side.orders + side.count, side.orders + N, 0);
+}
+
+// Publication filter for depth updates: keeps the last snapshot handed out and
+// only reports an update when something inside the top N changed, a level
+// coming or going deeper in the book doesn't wake the consumers.
+template<size_t N>
+class DepthPublisher {
+public:
+    template<typename Book>
+    bool update(Book& book) {
+        DepthSnapshot<N> fresh = book.template depth<N>();
+        if (fresh == last) {
+            return false;
+        }
+
+        last = fresh;
+        return true;
+    }
+
+    const DepthSnapshot<N>& snapshot() const {
+        return last;
+    }
+
+private:
+    DepthSnapshot<N> last;
+};
+
+}
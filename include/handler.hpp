@@ -2,19 +2,29 @@
 
 #include <algorithm>
 #include <benchmark/benchmark.h>
+#include <chrono>
 #include <cstdint>
 #include <absl/container/flat_hash_map.h>
 #include <emmintrin.h>
 #include <x86intrin.h>
 
+#include "adaptive_order_book.hpp"
+#include "book_analytics.hpp"
+#include "checkpoint.hpp"
+#include "depth_snapshot.hpp"
 #include "itch_parser.hpp"
 #include "levels/vector_levels_b_search_split.hpp"
 #include "order_book.hpp"
 #include "order_book_shared.hpp"
 #include "spmc_queue.hpp"
+#include "tick_order_book.hpp"
+#include "trade_tape.hpp"
 
 enum class StrategyMsgType : uint8_t {
     BookUpdate,
+    LevelUpdate,
+    Analytics,
+    Trade,
     Stop
 };
 
@@ -25,21 +35,69 @@ struct BookUpdateMsg {
     OB::Side side;
 };
 
+// one level of the book changed, feeds an OB::L2Replica on the consumer side
+struct LevelUpdateMsg {
+    uint64_t t0;
+    OB::LevelDelta delta;
+};
+
+// microstructure measures of the book, see OB::BookAnalytics
+struct AnalyticsMsg {
+    uint64_t t0;
+    OB::AnalyticsSnapshot analytics;
+};
+
+// one print of the trade tape, or a print taken back by a BrokenTrade. The
+// volume and the VWAP are those of the day after the print or the break
+struct TradeMsg {
+    uint64_t t0;
+    uint64_t match_number;
+    uint64_t timestamp;
+    uint64_t volume;
+    uint32_t price;
+    uint32_t qty;
+    uint32_t vwap;
+    OB::Side aggressor; // None for crosses and non-displayed executions
+    char cross_type;
+    bool broken;
+};
+
 struct StopMsg {};
 
+// top of book published to the instruments which ask for depth, too large for
+// the StrategyMsg union so it goes through a queue of its own
+inline constexpr size_t depth_levels = 10;
+
+struct DepthMsg {
+    uint64_t t0;
+    OB::DepthSnapshot<depth_levels> depth;
+};
+
 struct StrategyMsg {
     StrategyMsgType type;
 
     union {
         BookUpdateMsg book_update;
+        LevelUpdateMsg level_update;
+        AnalyticsMsg analytics;
+        TradeMsg trade;
         StopMsg stop;
     };
 };
 
+// a queue slot is the message plus an 8 byte version, keep it in one line
+static_assert(sizeof(StrategyMsg) <= 56);
+
 class Handler {
 public:
-    using Book = OB::OrderBook<OB::VectorLevelBSearchSplit>;
+    // every instrument picks its own level store from what its flow looks
+    // like and keeps its prices as tick indices of the instrument, they are
+    // turned back into ITCH prices when published.
+    // OB::L3OrderBook<OB::VectorLevelBSearchSplit> can be dropped in here when
+    // the strategies need the orders of every level in time priority
+    using Book = OB::TickOrderBook<OB::AdaptiveOrderBook<OB::HashOrderTable<>, 1>>;
     using Queue = SPMCQueue<StrategyMsg>;
+    using DepthQueue = SPMCQueue<DepthMsg>;
 
     void handle(const ITCH::StockDirectory&);
     void handle(const ITCH::AddOrderNoMpid&);
@@ -50,12 +108,34 @@ public:
     void handle(const ITCH::OrderDelete&);
     void handle(const ITCH::OrderReplace&);
     void handle(const ITCH::SystemEvent&);
+    void handle(const ITCH::IpoQuotationPeriodUpd&);
+    void handle(const ITCH::LuldAuctionCollar&);
+    void handle(const ITCH::TradeMessageNonCross&);
+    void handle(const ITCH::TradeMessageCross&);
+    void handle(const ITCH::BrokenTrade&);
 
-    void handle_change(const OB::BestLvlChange& best_lvl_change, uint64_t timestamp, Queue* queue);
+    void handle_change(const OB::BestLvlChange& best_lvl_change, uint64_t timestamp, uint16_t stock_locate, Queue* queue);
+    void handle_depth(uint16_t stock_locate, Book* book);
+    void handle_deltas(uint16_t stock_locate, const Book* book, Queue* queue, size_t count);
+    void handle_analytics(uint16_t stock_locate, const Book* book, Queue* queue, size_t count, uint64_t timestamp);
+    void handle_execution(uint16_t stock_locate, const Book* book, Queue* queue, uint64_t match_number, uint32_t qty, uint32_t price, uint64_t timestamp);
     void handle_after();
     void handle_before();
+    void handle_idle();
+    bool handle_sequence(uint64_t seq, uint16_t msg_count, uint16_t& skip);
+    void prefetch(const std::byte* msg);
+    void handle_packet_begin();
+    void handle_packet_end();
     void reset();
 
+    // journals the book operations to a background writer which checkpoints
+    // the handler state to path every interval
+    void enable_checkpoints(const std::string& path, std::chrono::milliseconds interval = std::chrono::seconds(10));
+    // rebuilds the books from a checkpoint, the packets it covers are then
+    // skipped. Call it after enable_checkpoints so the next checkpoints
+    // include the restored orders
+    bool restore(const std::string& path);
+
     uint64_t t0;
     unsigned aux_start;
 
@@ -66,33 +146,234 @@ public:
         return last_message;
     }
 
+    // the book of a locate, nullptr until its instrument is in the directory
+    const Book* book(uint16_t stock_locate) const {
+        return locate_to_book[stock_locate];
+    }
+
+    // the parser drops the messages of other instruments and of the types
+    // without a handler before decoding them
+    const ITCH::Subscription& subscription() const {
+        return subscription_;
+    }
+
+    // with the prefilter off every message is decoded and timed, the books
+    // still ignore the other instruments
+    void set_prefilter(bool on);
+
     struct InstrumentConfig {
         std::string symbol;
         Queue* queue;
+        // optional, gets the top depth_levels levels whenever one of them changes
+        DepthQueue* depth_queue = nullptr;
+        // every level change goes to the queue next to the best level updates
+        bool level_deltas = false;
+        // keeps OB::BookAnalytics on the book and publishes them when the
+        // microprice, the imbalance or the band depth change
+        bool analytics = false;
+        // keeps an OB::TradeTape of the executions, trade and cross messages
+        // and publishes every print and break with the day volume and VWAP.
+        // The tape starts when the handler goes live, a catch-up skips it
+        bool trades = false;
+        // price step from 1$ up, 100 is a cent, names quoted in half cents
+        // need 50. The first price off this grid moves the book to raw ITCH
+        // prices, see OB::TickOrderBook and codec_fallbacks()
+        uint32_t tick = 100;
     };
 
     uint64_t max_orders = 0;
 
-    Handler(const std::vector<InstrumentConfig>& instruments)
+    // best level updates seen and the ones which made it to the queues
+    uint64_t book_updates = 0;
+    uint64_t published_updates = 0;
+
+    // books which met a price off the tick grid of their instrument
+    uint64_t codec_fallbacks() const {
+        uint64_t fallbacks = 0;
+        for (const auto& book : books) {
+            fallbacks += book->codec_fallbacks;
+        }
+        return fallbacks;
+    }
+
+    // with conflate_packets the best levels and the depth of an instrument are
+    // published once per MoldUDP64 packet, with the net change of the packet
+    Handler(const std::vector<InstrumentConfig>& instruments, bool conflate_packets = false)
+        : conflate(conflate_packets)
     {
         locate_to_book.fill(nullptr);
         locate_to_queue.fill(nullptr);
+        locate_to_depth.fill(nullptr);
+        locate_to_conflated.fill(nullptr);
 
         for (const auto& cfg : instruments) {
             instruments_.emplace(pad_symbol(cfg.symbol), cfg);
         }
+        set_prefilter(true);
     }
 
+    // The handler as the ingestor drives it while catching up after a late
+    // join or a gap: the order messages only change the books, there is no
+    // timing, publication or bookkeeping on the way. The ingestor hands over
+    // to the live path at the end of the packet which reaches the target
+    // sequence or timestamp, so the consumers never see half a packet, and
+    // every book publishes its state as of the handover.
+    struct CatchUp {
+        Handler& handler;
+        uint64_t target_seq = 0;
+        uint64_t target_timestamp = 0;
+        bool active = false;
+
+        uint64_t messages = 0;
+        uint64_t timestamp = 0;
+        std::chrono::steady_clock::time_point start;
+
+        template<typename Msg>
+        void apply(const Msg& msg) {
+            Book* book = handler.locate_to_book[msg.stock_locate];
+            if (book != nullptr) {
+                handler.apply(book, msg);
+            }
+            timestamp = msg.timestamp;
+        }
+
+        void handle(const ITCH::AddOrderNoMpid& msg) { apply(msg); }
+        void handle(const ITCH::AddOrderMpid& msg) { apply(msg); }
+        void handle(const ITCH::OrderExecuted& msg) { apply(msg); }
+        void handle(const ITCH::OrderExecutedPrice& msg) { apply(msg); }
+        void handle(const ITCH::OrderCancel& msg) { apply(msg); }
+        void handle(const ITCH::OrderDelete& msg) { apply(msg); }
+        void handle(const ITCH::OrderReplace& msg) { apply(msg); }
+
+        // the messages the live path needs in any case, they also move the
+        // clock of a catch-up by timestamp
+        template<typename Msg>
+        void forward(const Msg& msg) {
+            handler.handle(msg);
+            timestamp = msg.timestamp;
+        }
+
+        void handle(const ITCH::StockDirectory& msg) { forward(msg); }
+        void handle(const ITCH::SystemEvent& msg) { forward(msg); }
+        void handle(const ITCH::IpoQuotationPeriodUpd& msg) { forward(msg); }
+        void handle(const ITCH::LuldAuctionCollar& msg) { forward(msg); }
+
+        bool handle_sequence(uint64_t seq, uint16_t msg_count, uint16_t& skip) {
+            if (!handler.handle_sequence(seq, msg_count, skip)) {
+                return false;
+            }
+            messages += msg_count - skip;
+            return true;
+        }
+
+        void prefetch(const std::byte* msg) {
+            handler.prefetch(msg);
+        }
+
+        void handle_packet_end();
+
+        bool should_stop() {
+            return handler.should_stop();
+        }
+
+        const ITCH::Subscription& subscription() const {
+            return handler.subscription();
+        }
+    };
+
+    // catches up until the MoldUDP64 sequence target_seq or the ITCH timestamp
+    // target_timestamp (ns since midnight) is reached, 0 leaves one unset
+    void start_catch_up(uint64_t target_seq, uint64_t target_timestamp);
+
+    bool catching_up() const {
+        return catch_up.active;
+    }
+
+    CatchUp catch_up{*this};
+
 private:
     std::unordered_map<std::string, InstrumentConfig> instruments_;
+    ITCH::Subscription subscription_;
 
     static constexpr size_t max_locates_ = 65536;
     std::vector<std::unique_ptr<Book>> books;
+    size_t idle_book = 0;
 
     std::array<Book*, max_locates_> locate_to_book{};
     std::array<Queue*, max_locates_> locate_to_queue{};
+    std::array<bool, max_locates_> locate_to_deltas{};
+
+    using Analytics = OB::BookAnalytics<>;
+
+    struct AnalyticsFeed {
+        Analytics analytics;
+        OB::AnalyticsSnapshot last{};
+    };
+
+    std::vector<std::unique_ptr<AnalyticsFeed>> analytics_feeds;
+    std::array<AnalyticsFeed*, max_locates_> locate_to_analytics{};
+
+    using Tape = OB::TradeTape<>;
+
+    std::vector<std::unique_ptr<Tape>> tapes;
+    std::array<Tape*, max_locates_> locate_to_tape{};
+
+    struct DepthFeed {
+        DepthQueue* queue;
+        OB::DepthPublisher<depth_levels> publisher;
+    };
+
+    std::vector<std::unique_ptr<DepthFeed>> depth_feeds;
+    std::array<DepthFeed*, max_locates_> locate_to_depth{};
+
+    // what an instrument changed during the current packet and what it
+    // published last, a side whose net change is a no-op isn't published
+    struct Conflated {
+        Book* book;
+        Queue* queue;
+        uint16_t stock_locate;
+        uint64_t t0 = 0;
+        OB::BestLvlChange bid{};
+        OB::BestLvlChange ask{};
+        OB::BestLvlChange published_bid{};
+        OB::BestLvlChange published_ask{};
+        bool dirty = false;
+        bool depth_dirty = false;
+    };
+
+    bool conflate;
+    bool in_packet = false;
+    std::vector<std::unique_ptr<Conflated>> conflated;
+    std::array<Conflated*, max_locates_> locate_to_conflated{};
+    std::vector<Conflated*> dirty;
+
+    void publish(const OB::BestLvlChange& best_lvl_change, uint64_t start, Queue* queue);
+    Conflated& mark_dirty(uint16_t stock_locate);
+    void publish_side(OB::BestLvlChange& change, OB::BestLvlChange& published, uint64_t start, Queue* queue);
+    void publish_depth(DepthFeed* feed, Book* book, uint64_t start);
+    void publish_trade(const OB::TradePrint& print, const Tape& tape, Queue* queue);
+    void publish_books(uint64_t timestamp);
 
     std::string pad_symbol(std::string_view);
+    void add_instrument(uint16_t stock_locate, const InstrumentConfig& config);
+
+    // MoldUDP64 sequence of the next message to apply
+    uint64_t next_seq = 0;
+    std::unique_ptr<CheckpointWriter> checkpoint;
+
+    OB::BestLvlChange apply(Book* book, const ITCH::AddOrderNoMpid& msg);
+    OB::BestLvlChange apply(Book* book, const ITCH::AddOrderMpid& msg);
+    OB::BestLvlChange apply(Book* book, const ITCH::OrderExecuted& msg);
+    OB::BestLvlChange apply(Book* book, const ITCH::OrderExecutedPrice& msg);
+    OB::BestLvlChange apply(Book* book, const ITCH::OrderCancel& msg);
+    OB::BestLvlChange apply(Book* book, const ITCH::OrderDelete& msg);
+    OB::BestLvlChange apply(Book* book, const ITCH::OrderReplace& msg);
+
+    void journal(const CheckpointOp& op) {
+        if (checkpoint != nullptr) {
+            checkpoint->push(op);
+        }
+    }
 
     struct BookQueue {
         Book* book;
@@ -100,6 +381,11 @@ private:
     };
 
     BookQueue get_book_queue(uint16_t);
+
+    template<typename Layout, auto OrderId>
+    static void prefetch_order(const Book* book, const std::byte* fields) {
+        book->prefetch_order(ITCH::MsgView<Layout>(fields).template get<OrderId>());
+    }
 };
 
 inline void Handler::handle_before() {
@@ -108,15 +394,22 @@ inline void Handler::handle_before() {
 
 inline void Handler::handle_after() {}
 
-inline void Handler::handle_change(const OB::BestLvlChange& best_lvl_change, uint64_t timestamp, Queue* queue) {
-    if (best_lvl_change.side == OB::Side::None) {
+// called by the ingestor when a burst comes back empty, lets one book at a
+// time tidy up its level stores so an idle tick stays short
+inline void Handler::handle_idle() {
+    if (books.empty()) {
         return;
     }
 
+    idle_book = idle_book + 1 < books.size() ? idle_book + 1 : 0;
+    books[idle_book]->idle();
+}
+
+inline void Handler::publish(const OB::BestLvlChange& best_lvl_change, uint64_t start, Queue* queue) {
     auto msg = StrategyMsg {
         .type = StrategyMsgType::BookUpdate,
         .book_update {
-            .t0 = t0,
+            .t0 = start,
             .qty = best_lvl_change.qty,
             .price = best_lvl_change.price,
             .side = best_lvl_change.side
@@ -124,6 +417,276 @@ inline void Handler::handle_change(const OB::BestLvlChange& best_lvl_change, uin
     };
 
     queue->push(msg);
+    published_updates++;
+}
+
+inline void Handler::handle_change(const OB::BestLvlChange& best_lvl_change, uint64_t timestamp, uint16_t stock_locate, Queue* queue) {
+    if (best_lvl_change.side == OB::Side::None) {
+        return;
+    }
+
+    book_updates++;
+    if (!conflate) {
+        publish(best_lvl_change, t0, queue);
+        return;
+    }
+
+    if (in_packet) {
+        Conflated& c = mark_dirty(stock_locate);
+        (best_lvl_change.side == OB::Side::Bid ? c.bid : c.ask) = best_lvl_change;
+        return;
+    }
+
+    // outside of a packet, still remember what the consumers saw last
+    Conflated& c = *locate_to_conflated[stock_locate];
+    publish(best_lvl_change, t0, queue);
+    (best_lvl_change.side == OB::Side::Bid ? c.published_bid : c.published_ask) = best_lvl_change;
+}
+
+// the latency of a conflated update is measured from the first message of
+// the packet which touched the instrument
+inline Handler::Conflated& Handler::mark_dirty(uint16_t stock_locate) {
+    Conflated& c = *locate_to_conflated[stock_locate];
+    if (!c.dirty) {
+        c.dirty = true;
+        c.t0 = t0;
+        dirty.push_back(&c);
+    }
+
+    return c;
+}
+
+inline void Handler::handle_packet_begin() {
+    in_packet = conflate;
+}
+
+inline void Handler::publish_side(OB::BestLvlChange& change, OB::BestLvlChange& published, uint64_t start, Queue* queue) {
+    if (change.side == OB::Side::None) {
+        return;
+    }
+
+    if (change.qty != published.qty || change.price != published.price) {
+        publish(change, start, queue);
+        published = change;
+    }
+    change = {};
+}
+
+inline void Handler::handle_packet_end() {
+    in_packet = false;
+
+    for (Conflated* c : dirty) {
+        publish_side(c->bid, c->published_bid, c->t0, c->queue);
+        publish_side(c->ask, c->published_ask, c->t0, c->queue);
+
+        if (c->depth_dirty) {
+            publish_depth(locate_to_depth[c->stock_locate], c->book, c->t0);
+        }
+        c->dirty = false;
+        c->depth_dirty = false;
+    }
+
+    dirty.clear();
+    journal({ .other = next_seq, .type = CheckpointOpType::PacketEnd });
+}
+
+// Called by ItchParser::parse_batch for every message of a packet before the
+// first one is applied: the order table slots the order messages are going
+// to hit are prefetched, so their cache misses overlap instead of each
+// operation waiting for its own. A replace prefetches the order it replaces,
+// an add the slot it is inserted into.
+inline void Handler::prefetch(const std::byte* msg) {
+    const Book* book = locate_to_book[ITCH::load_be16(msg + 1)];
+    if (book == nullptr) {
+        return;
+    }
+
+    const std::byte* fields = msg + 1;
+    switch (char(msg[0])) {
+        case 'A': prefetch_order<ITCH::AddOrderNoMpidLayout, &ITCH::AddOrderNoMpid::order_reference_number>(book, fields); break;
+        case 'F': prefetch_order<ITCH::AddOrderMpidLayout, &ITCH::AddOrderMpid::order_reference_number>(book, fields); break;
+        case 'E': prefetch_order<ITCH::OrderExecutedLayout, &ITCH::OrderExecuted::order_reference_number>(book, fields); break;
+        case 'C': prefetch_order<ITCH::OrderExecutedPriceLayout, &ITCH::OrderExecutedPrice::order_reference_number>(book, fields); break;
+        case 'X': prefetch_order<ITCH::OrderCancelLayout, &ITCH::OrderCancel::order_reference_number>(book, fields); break;
+        case 'D': prefetch_order<ITCH::OrderDeleteLayout, &ITCH::OrderDelete::order_reference_number>(book, fields); break;
+        case 'U': prefetch_order<ITCH::OrderReplaceLayout, &ITCH::OrderReplace::order_reference_number>(book, fields); break;
+        default: break;
+    }
+}
+
+// seq is the MoldUDP64 sequence of the first message of the packet. The
+// packets a restored checkpoint or an earlier packet already cover are
+// dropped. A packet which overlaps them (a retransmission cut differently,
+// a checkpoint taken mid-stream by another instance) is applied from the
+// first message not seen yet, skip is the number of messages before it
+inline bool Handler::handle_sequence(uint64_t seq, uint16_t msg_count, uint16_t& skip) {
+    if (seq + msg_count <= next_seq) {
+        return false;
+    }
+
+    skip = seq < next_seq ? uint16_t(next_seq - seq) : 0;
+    next_seq = seq + msg_count;
+    return true;
+}
+
+// the deltas go out before the best level update of the same message, so a
+// replica is current by the time the strategy sees the new best level
+inline void Handler::handle_deltas(uint16_t stock_locate, const Book* book, Queue* queue, size_t count) {
+    if (!locate_to_deltas[stock_locate]) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        queue->push(StrategyMsg{
+            .type = StrategyMsgType::LevelUpdate,
+            .level_update {
+                .t0 = t0,
+                .delta = book->delta(i)
+            }
+        });
+    }
+}
+
+// the analytics follow the decoded deltas of the book, the rates run on the
+// ITCH timestamps
+inline void Handler::handle_analytics(uint16_t stock_locate, const Book* book, Queue* queue, size_t count, uint64_t timestamp) {
+    AnalyticsFeed* feed = locate_to_analytics[stock_locate];
+    if (feed == nullptr) {
+        return;
+    }
+
+    OB::LevelDelta deltas[2];
+    for (size_t i = 0; i < count; ++i) {
+        deltas[i] = book->delta(i);
+    }
+    feed->analytics.apply(deltas, count, *book, timestamp);
+
+    OB::AnalyticsSnapshot now = feed->analytics.snapshot(timestamp);
+    if (now.microprice == feed->last.microprice && now.imbalance == feed->last.imbalance
+        && now.bid_depth == feed->last.bid_depth && now.ask_depth == feed->last.ask_depth) {
+        return;
+    }
+
+    feed->last = now;
+    queue->push(StrategyMsg{
+        .type = StrategyMsgType::Analytics,
+        .analytics {
+            .t0 = t0,
+            .analytics = now
+        }
+    });
+}
+
+inline void Handler::publish_trade(const OB::TradePrint& print, const Tape& tape, Queue* queue) {
+    queue->push(StrategyMsg{
+        .type = StrategyMsgType::Trade,
+        .trade {
+            .t0 = t0,
+            .match_number = print.match_number,
+            .timestamp = print.timestamp,
+            .volume = tape.volume(),
+            .price = print.price,
+            .qty = print.qty,
+            .vwap = tape.vwap(),
+            .aggressor = print.aggressor,
+            .cross_type = print.cross_type,
+            .broken = print.broken
+        }
+    });
+}
+
+// an execution against a resting order, the aggressor is on the other side.
+// The resting order's level is the first delta of the execute, price is 0
+// when the order's own price is the execution price
+inline void Handler::handle_execution(uint16_t stock_locate, const Book* book, Queue* queue, uint64_t match_number, uint32_t qty, uint32_t price, uint64_t timestamp) {
+    Tape* tape = locate_to_tape[stock_locate];
+    if (tape == nullptr) {
+        return;
+    }
+
+    OB::LevelDelta resting = book->delta(0);
+    const OB::TradePrint& print = tape->add({
+        .match_number = match_number,
+        .timestamp = timestamp,
+        .price = price == 0 ? resting.price : price,
+        .qty = qty,
+        .aggressor = resting.side == OB::Side::Bid ? OB::Side::Ask : OB::Side::Bid,
+        .cross_type = 0,
+        .broken = false
+    });
+    publish_trade(print, *tape, queue);
+}
+
+inline void Handler::publish_depth(DepthFeed* feed, Book* book, uint64_t start) {
+    if (!feed->publisher.update(*book)) {
+        return;
+    }
+
+    feed->queue->push(DepthMsg{
+        .t0 = start,
+        .depth = feed->publisher.snapshot()
+    });
+}
+
+// the consumers saw nothing of what a catch-up did to the books: every book
+// publishes its best levels, its depth and its analytics as they are now, and
+// the conflation and the analytics start over from that state
+inline void Handler::publish_books(uint64_t timestamp) {
+    t0 = __rdtscp(&aux_start);
+
+    for (size_t locate = 0; locate < max_locates_; ++locate) {
+        Book* book = locate_to_book[locate];
+        if (book == nullptr) {
+            continue;
+        }
+
+        Queue* queue = locate_to_queue[locate];
+        OB::Level bid = book->best_bid();
+        OB::Level ask = book->best_ask();
+        OB::BestLvlChange bid_change{ .qty = bid.qty, .price = bid.price, .side = OB::Side::Bid };
+        OB::BestLvlChange ask_change{ .qty = ask.qty, .price = ask.price, .side = OB::Side::Ask };
+        publish(bid_change, t0, queue);
+        publish(ask_change, t0, queue);
+
+        if (Conflated* c = locate_to_conflated[locate]; c != nullptr) {
+            c->published_bid = bid_change;
+            c->published_ask = ask_change;
+        }
+
+        if (DepthFeed* feed = locate_to_depth[locate]; feed != nullptr) {
+            feed->publisher.update(*book);
+            feed->queue->push(DepthMsg{
+                .t0 = t0,
+                .depth = feed->publisher.snapshot()
+            });
+        }
+
+        if (AnalyticsFeed* feed = locate_to_analytics[locate]; feed != nullptr) {
+            feed->analytics.resync(*book);
+            feed->last = feed->analytics.snapshot(timestamp);
+            queue->push(StrategyMsg{
+                .type = StrategyMsgType::Analytics,
+                .analytics {
+                    .t0 = t0,
+                    .analytics = feed->last
+                }
+            });
+        }
+    }
+}
+
+inline void Handler::handle_depth(uint16_t stock_locate, Book* book) {
+    DepthFeed* feed = locate_to_depth[stock_locate];
+    if (feed == nullptr) {
+        return;
+    }
+
+    if (in_packet) {
+        mark_dirty(stock_locate).depth_dirty = true;
+        return;
+    }
+
+    publish_depth(feed, book, t0);
 }
 
 inline Handler::BookQueue Handler::get_book_queue(uint16_t stock_locate) {
@@ -136,12 +699,21 @@ inline Handler::BookQueue Handler::get_book_queue(uint16_t stock_locate) {
 inline void Handler::handle(const ITCH::SystemEvent& msg) {
     if (msg.event_code == 'C') { // last message
         last_message = true;
+        handle_packet_end(); // the conflated updates go out before the stop
         for (auto q : locate_to_queue) {
             if (q != nullptr) {
                 q->push({ .type = StrategyMsgType::Stop });
             }
         }
         std::cout << "Max orders: " << max_orders << '\n';
+        std::cout << "Best level updates: " << book_updates << ", published: " << published_updates << '\n';
+        std::cout << "Books off their tick grid: " << codec_fallbacks() << '\n';
+        if (checkpoint != nullptr) {
+            checkpoint->stop();
+            std::cout << "Checkpoints written: " << checkpoint->written << ", skipped: " << checkpoint->skipped
+                      << ", journal stalls: " << checkpoint->stalls << '\n';
+            checkpoint.reset();
+        }
     } else if (msg.event_code == 'Q') { // start of market hours
         record_prices = true;
     } else if (msg.event_code == 'M') { // end of market hours
@@ -155,6 +727,43 @@ inline std::string Handler::pad_symbol(std::string_view symbol) {
     return out;
 }
 
+inline void Handler::add_instrument(uint16_t stock_locate, const InstrumentConfig& config) {
+    books.emplace_back(std::make_unique<Book>(OB::PriceCodec(config.tick)));
+
+    locate_to_book[stock_locate] = books.back().get();
+    locate_to_queue[stock_locate] = config.queue;
+    locate_to_deltas[stock_locate] = config.level_deltas;
+    subscription_.subscribe(stock_locate);
+
+    if (conflate) {
+        conflated.emplace_back(std::make_unique<Conflated>(Conflated{
+            .book = books.back().get(),
+            .queue = config.queue,
+            .stock_locate = stock_locate
+        }));
+        locate_to_conflated[stock_locate] = conflated.back().get();
+    }
+
+    if (config.analytics) {
+        analytics_feeds.emplace_back(std::make_unique<AnalyticsFeed>());
+        locate_to_analytics[stock_locate] = analytics_feeds.back().get();
+    }
+
+    if (config.trades) {
+        tapes.emplace_back(std::make_unique<Tape>());
+        locate_to_tape[stock_locate] = tapes.back().get();
+    }
+
+    if (config.depth_queue != nullptr) {
+        depth_feeds.emplace_back(std::make_unique<DepthFeed>(DepthFeed{ .queue = config.depth_queue }));
+        locate_to_depth[stock_locate] = depth_feeds.back().get();
+    }
+
+    uint64_t symbol;
+    std::memcpy(&symbol, pad_symbol(config.symbol).data(), sizeof(symbol));
+    journal({ .other = symbol, .locate = stock_locate, .type = CheckpointOpType::Instrument });
+}
+
 inline void Handler::handle(const ITCH::StockDirectory& msg) {
     std::string sym(msg.stock, 8);
 
@@ -163,10 +772,153 @@ inline void Handler::handle(const ITCH::StockDirectory& msg) {
         return;
     }
 
-    books.emplace_back(std::make_unique<Book>());
+    add_instrument(msg.stock_locate, it->second);
+}
+
+inline void Handler::set_prefilter(bool on) {
+    using Filter = ITCH::Subscription::Filter;
+    Filter by_locate = on ? Filter::Locate : Filter::All;
+
+    subscription_.deliver('S', Filter::All);
+    subscription_.deliver('R', Filter::All);
+    for (char type : {'A', 'F', 'E', 'C', 'X', 'D', 'U', 'P', 'Q', 'B', 'K', 'J'}) {
+        subscription_.deliver(type, by_locate);
+    }
+    for (char type : {'H', 'Y', 'L', 'V', 'W', 'h', 'I', 'O'}) {
+        subscription_.deliver(type, on ? Filter::Drop : Filter::All);
+    }
+}
+
+inline void Handler::enable_checkpoints(const std::string& path, std::chrono::milliseconds interval) {
+    OB::UNEXPECTED(!books.empty(), "Checkpoints have to be enabled before the first instrument");
+    checkpoint = std::make_unique<CheckpointWriter>(path, interval);
+}
+
+inline void Handler::start_catch_up(uint64_t target_seq, uint64_t target_timestamp) {
+    catch_up.target_seq = target_seq;
+    catch_up.target_timestamp = target_timestamp;
+    catch_up.messages = 0;
+    catch_up.start = std::chrono::steady_clock::now();
+    catch_up.active = (target_seq != 0 && next_seq < target_seq) || target_timestamp != 0;
+}
+
+inline void Handler::CatchUp::handle_packet_end() {
+    handler.journal({ .other = handler.next_seq, .type = CheckpointOpType::PacketEnd });
+
+    bool reached = (target_seq != 0 && handler.next_seq >= target_seq)
+        || (target_timestamp != 0 && timestamp >= target_timestamp);
+    if (!reached) {
+        return;
+    }
+
+    active = false;
+    for (const auto& book : handler.books) {
+        handler.max_orders = std::max(handler.max_orders, book->orders_map.size());
+    }
+    handler.publish_books(timestamp);
+
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Caught up to sequence " << handler.next_seq << ": " << messages << " messages in "
+              << ns / 1'000'000 << "ms, " << (ns == 0 ? 0 : messages * 1'000'000'000 / ns) << " msgs/s\n";
+}
+
+inline bool Handler::restore(const std::string& path) {
+    CheckpointImage image;
+    if (!read_checkpoint(path, image)) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (const CheckpointInstrument& instrument : image.instruments) {
+        auto it = instruments_.find(std::string(instrument.symbol, 8));
+        if (it == instruments_.end() || locate_to_book[instrument.locate] != nullptr) {
+            continue;
+        }
+        add_instrument(instrument.locate, it->second);
+    }
+
+    // the books publish nothing while they are rebuilt, the consumers get the
+    // restored state with the first change of every instrument
+    for (const CheckpointOrder& order : image.orders) {
+        Book* book = locate_to_book[order.locate];
+        if (book == nullptr) {
+            continue;
+        }
+        book->add_order(order.order_id, order.side, order.qty, order.price);
+        max_orders = std::max(max_orders, book->orders_map.size());
+        journal({
+            .order_id = order.order_id,
+            .qty = order.qty,
+            .price = order.price,
+            .locate = order.locate,
+            .type = CheckpointOpType::Add,
+            .side = order.side
+        });
+    }
+
+    next_seq = image.header.next_seq;
+    std::cout << "Restored " << image.orders.size() << " orders of " << image.instruments.size()
+              << " instruments up to sequence " << next_seq << " in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << "ms\n";
+    return true;
+}
+
+// the book operation of an order message and its journal entry, shared by
+// the live path and the catch-up path
+inline OB::BestLvlChange Handler::apply(Book* book, const ITCH::AddOrderNoMpid& msg) {
+    journal({
+        .order_id = msg.order_reference_number,
+        .qty = msg.shares,
+        .price = msg.price,
+        .locate = msg.stock_locate,
+        .type = CheckpointOpType::Add,
+        .side = static_cast<OB::Side>(msg.buy_sell)
+    });
+    return book->add_order(msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
+}
+
+inline OB::BestLvlChange Handler::apply(Book* book, const ITCH::AddOrderMpid& msg) {
+    journal({
+        .order_id = msg.order_reference_number,
+        .qty = msg.shares,
+        .price = msg.price,
+        .locate = msg.stock_locate,
+        .type = CheckpointOpType::Add,
+        .side = static_cast<OB::Side>(msg.buy_sell)
+    });
+    return book->add_order(msg.order_reference_number, static_cast<OB::Side>(msg.buy_sell), msg.shares, msg.price);
+}
+
+inline OB::BestLvlChange Handler::apply(Book* book, const ITCH::OrderExecuted& msg) {
+    journal({ .order_id = msg.order_reference_number, .qty = msg.executed_shares, .type = CheckpointOpType::Reduce });
+    return book->execute_order(msg.order_reference_number, msg.executed_shares);
+}
+
+inline OB::BestLvlChange Handler::apply(Book* book, const ITCH::OrderExecutedPrice& msg) {
+    journal({ .order_id = msg.order_reference_number, .qty = msg.executed_shares, .type = CheckpointOpType::Reduce });
+    return book->execute_order(msg.order_reference_number, msg.executed_shares);
+}
+
+inline OB::BestLvlChange Handler::apply(Book* book, const ITCH::OrderCancel& msg) {
+    journal({ .order_id = msg.order_reference_number, .qty = msg.cancelled_shares, .type = CheckpointOpType::Reduce });
+    return book->cancel_order(msg.order_reference_number, msg.cancelled_shares);
+}
+
+inline OB::BestLvlChange Handler::apply(Book* book, const ITCH::OrderDelete& msg) {
+    journal({ .order_id = msg.order_reference_number, .type = CheckpointOpType::Delete });
+    return book->delete_order(msg.order_reference_number);
+}
 
-    locate_to_book[msg.stock_locate] = books.back().get();
-    locate_to_queue[msg.stock_locate] = it->second.queue;
+inline OB::BestLvlChange Handler::apply(Book* book, const ITCH::OrderReplace& msg) {
+    journal({
+        .order_id = msg.order_reference_number,
+        .other = msg.new_reference_number,
+        .qty = msg.shares,
+        .price = msg.price,
+        .type = CheckpointOpType::Replace
+    });
+    return book->replace_order(msg.order_reference_number, msg.new_reference_number, msg.shares, msg.price);
 }
 
 inline void Handler::handle(const ITCH::AddOrderNoMpid& msg) {
@@ -175,16 +927,13 @@ inline void Handler::handle(const ITCH::AddOrderNoMpid& msg) {
         return;
     }
 
-    auto change = book->add_order(
-        msg.order_reference_number,
-        static_cast<OB::Side>(msg.buy_sell),
-        msg.shares,
-        msg.price
-    );
-
+    auto change = apply(book, msg);
     max_orders = std::max(max_orders, book->orders_map.size());
 
-    handle_change(change, msg.timestamp, queue);
+    handle_deltas(msg.stock_locate, book, queue, 1);
+    handle_analytics(msg.stock_locate, book, queue, 1, msg.timestamp);
+    handle_change(change, msg.timestamp, msg.stock_locate, queue);
+    handle_depth(msg.stock_locate, book);
 }
 
 inline void Handler::handle(const ITCH::AddOrderMpid& msg) {
@@ -193,16 +942,13 @@ inline void Handler::handle(const ITCH::AddOrderMpid& msg) {
         return;
     }
 
-    auto change = book->add_order(
-        msg.order_reference_number,
-        static_cast<OB::Side>(msg.buy_sell),
-        msg.shares,
-        msg.price
-    );
-
+    auto change = apply(book, msg);
     max_orders = std::max(max_orders, book->orders_map.size());
 
-    handle_change(change, msg.timestamp, queue);
+    handle_deltas(msg.stock_locate, book, queue, 1);
+    handle_analytics(msg.stock_locate, book, queue, 1, msg.timestamp);
+    handle_change(change, msg.timestamp, msg.stock_locate, queue);
+    handle_depth(msg.stock_locate, book);
 }
 
 inline void Handler::handle(const ITCH::OrderExecuted& msg) {
@@ -211,24 +957,30 @@ inline void Handler::handle(const ITCH::OrderExecuted& msg) {
         return;
     }
 
-    auto change = book->execute_order(
-        msg.order_reference_number,
-        msg.executed_shares
-    );
-    handle_change(change, msg.timestamp, queue);
+    auto change = apply(book, msg);
+    handle_execution(msg.stock_locate, book, queue, msg.match_number, msg.executed_shares, 0, msg.timestamp);
+    handle_deltas(msg.stock_locate, book, queue, 1);
+    handle_analytics(msg.stock_locate, book, queue, 1, msg.timestamp);
+    handle_change(change, msg.timestamp, msg.stock_locate, queue);
+    handle_depth(msg.stock_locate, book);
 }
 
+// a non-printable execution (part of a cross) changes the book but not the
+// tape, the cross message prints it
 inline void Handler::handle(const ITCH::OrderExecutedPrice& msg) {
     auto [book, queue] = get_book_queue(msg.stock_locate);
     if (book == nullptr) {
         return;
     }
 
-    auto change = book->execute_order(
-        msg.order_reference_number,
-        msg.executed_shares
-    );
-    handle_change(change, msg.timestamp, queue);
+    auto change = apply(book, msg);
+    if (msg.printable == 'Y') {
+        handle_execution(msg.stock_locate, book, queue, msg.match_number, msg.executed_shares, msg.execution_price, msg.timestamp);
+    }
+    handle_deltas(msg.stock_locate, book, queue, 1);
+    handle_analytics(msg.stock_locate, book, queue, 1, msg.timestamp);
+    handle_change(change, msg.timestamp, msg.stock_locate, queue);
+    handle_depth(msg.stock_locate, book);
 }
 
 inline void Handler::handle(const ITCH::OrderCancel& msg) {
@@ -237,11 +989,11 @@ inline void Handler::handle(const ITCH::OrderCancel& msg) {
         return;
     }
 
-    auto change = book->cancel_order(
-        msg.order_reference_number,
-        msg.cancelled_shares
-    );
-    handle_change(change, msg.timestamp, queue);
+    auto change = apply(book, msg);
+    handle_deltas(msg.stock_locate, book, queue, 1);
+    handle_analytics(msg.stock_locate, book, queue, 1, msg.timestamp);
+    handle_change(change, msg.timestamp, msg.stock_locate, queue);
+    handle_depth(msg.stock_locate, book);
 }
 
 inline void Handler::handle(const ITCH::OrderDelete& msg) {
@@ -250,8 +1002,11 @@ inline void Handler::handle(const ITCH::OrderDelete& msg) {
         return;
     }
 
-    auto change = book->delete_order(msg.order_reference_number);
-    handle_change(change, msg.timestamp, queue);
+    auto change = apply(book, msg);
+    handle_deltas(msg.stock_locate, book, queue, 1);
+    handle_analytics(msg.stock_locate, book, queue, 1, msg.timestamp);
+    handle_change(change, msg.timestamp, msg.stock_locate, queue);
+    handle_depth(msg.stock_locate, book);
 }
 
 inline void Handler::handle(const ITCH::OrderReplace& msg) {
@@ -260,11 +1015,81 @@ inline void Handler::handle(const ITCH::OrderReplace& msg) {
         return;
     }
 
-    auto change = book->replace_order(
-        msg.order_reference_number,
-        msg.new_reference_number,
-        msg.shares,
-        msg.price
-    );
-    handle_change(change, msg.timestamp, queue);
+    auto change = apply(book, msg);
+    handle_deltas(msg.stock_locate, book, queue, 2);
+    handle_analytics(msg.stock_locate, book, queue, 2, msg.timestamp);
+    handle_change(change, msg.timestamp, msg.stock_locate, queue);
+    handle_depth(msg.stock_locate, book);
+}
+
+// the stock directory carries no price, the first reference price a book can
+// get is the IPO price or the LULD auction collar reference
+inline void Handler::handle(const ITCH::IpoQuotationPeriodUpd& msg) {
+    auto [book, queue] = get_book_queue(msg.stock_locate);
+    if (book == nullptr || msg.ipo_price == 0) {
+        return;
+    }
+
+    book->seed_reference_price(msg.ipo_price);
+}
+
+inline void Handler::handle(const ITCH::LuldAuctionCollar& msg) {
+    auto [book, queue] = get_book_queue(msg.stock_locate);
+    if (book == nullptr) {
+        return;
+    }
+
+    book->seed_reference_price(msg.auction_collar_reference_price);
+}
+
+// executions of non-displayed orders, they never were in the book. Nasdaq
+// sends 'B' in buy_sell whatever the side, so the aggressor is not known
+inline void Handler::handle(const ITCH::TradeMessageNonCross& msg) {
+    Tape* tape = locate_to_tape[msg.stock_locate];
+    if (tape == nullptr) {
+        return;
+    }
+
+    const OB::TradePrint& print = tape->add({
+        .match_number = msg.match_number,
+        .timestamp = msg.timestamp,
+        .price = msg.price,
+        .qty = msg.shares,
+        .aggressor = OB::Side::None,
+        .cross_type = 0,
+        .broken = false
+    });
+    publish_trade(print, *tape, locate_to_queue[msg.stock_locate]);
+}
+
+// the bulk print of an opening, closing, halt or IPO cross, a cross which
+// matched nothing comes with 0 shares
+inline void Handler::handle(const ITCH::TradeMessageCross& msg) {
+    Tape* tape = locate_to_tape[msg.stock_locate];
+    if (tape == nullptr || msg.shares == 0) {
+        return;
+    }
+
+    const OB::TradePrint& print = tape->add({
+        .match_number = msg.match_number,
+        .timestamp = msg.timestamp,
+        .price = msg.cross_price,
+        .qty = msg.shares,
+        .aggressor = OB::Side::None,
+        .cross_type = msg.cross_type,
+        .broken = false
+    });
+    publish_trade(print, *tape, locate_to_queue[msg.stock_locate]);
+}
+
+inline void Handler::handle(const ITCH::BrokenTrade& msg) {
+    Tape* tape = locate_to_tape[msg.stock_locate];
+    if (tape == nullptr) {
+        return;
+    }
+
+    const OB::TradePrint* print = tape->bust(msg.match_number);
+    if (print != nullptr) {
+        publish_trade(*print, *tape, locate_to_queue[msg.stock_locate]);
+    }
 }
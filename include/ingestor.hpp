@@ -11,24 +11,69 @@
 
 namespace ITCH {
 
+// how a packet payload is parsed, see ItchParser::parse_batch
+enum class ParseMode {
+    Sequential,
+    Batched,
+    BatchedByType
+};
+
 template<typename Handler>
 class Ingestor {
 public:
-    explicit Ingestor(Handler& handler, DPDKContext& dpdk_context)
-        : handler_(handler), dpdk_context_(dpdk_context) {}
+    explicit Ingestor(Handler& handler, DPDKContext& dpdk_context, ParseMode mode = ParseMode::Sequential)
+        : handler_(handler), dpdk_context_(dpdk_context), mode_(mode) {}
 
     void ingest_messages();
 
 private:
+    template<typename PacketHandler>
+    void handle_packet(PacketHandler& handler, const std::byte* p, size_t len, uint64_t seq, uint16_t msg_count);
+
     ItchParser parser_;
     Handler& handler_;
     DPDKContext& dpdk_context_;
+    ParseMode mode_;
 };
 
-[[gnu::noinline]] static void log_progress(size_t total_size, uint64_t pkts, uint64_t msgs) {
+[[gnu::noinline]] static void log_progress(size_t total_size, uint64_t pkts, uint64_t msgs, uint64_t packet_ns) {
     std::cout << "Received ITCH: " << total_size << '\n';
     std::cout << "PpS: " << pkts << '\n';
     std::cout << "Msg/s: " << msgs << '\n';
+    std::cout << "ns/packet: " << (pkts == 0 ? 0 : packet_ns / pkts) << '\n';
+}
+
+// One MoldUDP64 packet, p points to its first message. The handler is either
+// the live one or the catch-up path of it, each gets its own parser dispatch
+template<typename PacketHandler>
+inline void parse_packet(ItchParser& parser, PacketHandler& handler, const std::byte* p, size_t len, uint64_t seq, uint16_t msg_count, ParseMode mode) {
+    // messages at the start of the packet which were already applied
+    uint16_t skip = 0;
+    if constexpr (requires { handler.handle_sequence(seq, msg_count, skip); }) {
+        if (!handler.handle_sequence(seq, msg_count, skip)) {
+            return; // already applied, e.g. covered by a restored checkpoint
+        }
+    }
+
+    if constexpr (requires { handler.handle_packet_begin(); }) {
+        handler.handle_packet_begin();
+    }
+
+    if (mode == ParseMode::Sequential) {
+        parser.parse(p, len, handler, skip);
+    } else {
+        parser.parse_batch(p, len, handler, mode == ParseMode::BatchedByType, skip);
+    }
+
+    if constexpr (requires { handler.handle_packet_end(); }) {
+        handler.handle_packet_end();
+    }
+}
+
+template<typename Handler>
+template<typename PacketHandler>
+inline void Ingestor<Handler>::handle_packet(PacketHandler& handler, const std::byte* p, size_t len, uint64_t seq, uint16_t msg_count) {
+    parse_packet(parser_, handler, p, len, seq, msg_count, mode_);
 }
 
 template<typename Handler>
@@ -41,11 +86,19 @@ void Ingestor<Handler>::ingest_messages() {
     size_t total_size = 0;
     uint64_t msgs = 0;
     uint64_t pkts = 0;
+    // TSC cycles spent in the parser and the handler, the CPU time per packet
+    uint64_t packet_cycles = 0;
 
     while (!handler_.should_stop()) {
         uint16_t n = rte_eth_rx_burst(dpdk_context_.get_port_id(), 0, bufs, 64);
         pkts += n;
 
+        if constexpr (requires { handler_.handle_idle(); }) {
+            if (n == 0) {
+                handler_.handle_idle();
+            }
+        }
+
         for (int i = 0; i < n; ++i) {
             rte_mbuf* m = bufs[i];
             static int pkt_i = 0;
@@ -76,16 +129,28 @@ void Ingestor<Handler>::ingest_messages() {
             msgs += msg_count;
             size_t itch_len = rte_be_to_cpu_16(udp->dgram_len) - sizeof(rte_udp_hdr) - 20;
 
-            parser_.parse(p, itch_len, handler_);
+            uint64_t start = rte_rdtsc();
             total_size += itch_len;
+
+            if constexpr (requires { handler_.catching_up(); }) {
+                if (handler_.catching_up()) [[unlikely]] {
+                    handle_packet(handler_.catch_up, p, itch_len, seq, msg_count);
+                    packet_cycles += rte_rdtsc() - start;
+                    continue;
+                }
+            }
+
+            handle_packet(handler_, p, itch_len, seq, msg_count);
+            packet_cycles += rte_rdtsc() - start;
         }
 
         rte_pktmbuf_free_bulk(bufs, n);
         uint64_t now = rte_get_timer_cycles();
         if (now - last_print > hz) {
-            log_progress(total_size, pkts, msgs);
+            log_progress(total_size, pkts, msgs, uint64_t(double(packet_cycles) * 1e9 / double(hz)));
             pkts = 0;
             msgs = 0;
+            packet_cycles = 0;
             last_print = now;
         }
     }
@@ -2,13 +2,20 @@
 
 #include <cstddef>
 #include <stdint.h>
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <stdexcept>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <tuple>
 
+#if defined(__SSSE3__) && !defined(ITCH_SCALAR_DECODE)
+#define ITCH_SHUFFLE_DECODE
+#include <immintrin.h>
+#endif
+
 namespace ITCH {
 
 #if defined(__GNUC__) || defined(__clang__)
@@ -84,34 +91,31 @@ inline char load_be<char>(const std::byte* p) noexcept {
     return static_cast<char>(*p);
 }
 
+// one unaligned load and a byte swap, a movbe where the target has it
 template<>
 inline uint16_t load_be<uint16_t>(const std::byte* p) noexcept {
-    return (uint16_t(p[0]) << 8) | uint16_t(p[1]);
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return __builtin_bswap16(v);
 }
 
 template<>
 inline uint32_t load_be<uint32_t>(const std::byte* p) noexcept {
-    return (uint32_t(p[0]) << 24) |
-           (uint32_t(p[1]) << 16) |
-           (uint32_t(p[2]) << 8)  |
-           uint32_t(p[3]);
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return __builtin_bswap32(v);
 }
 
 template<>
 inline uint64_t load_be<uint64_t>(const std::byte* p) noexcept {
-    return (uint64_t(p[0]) << 56) |
-           (uint64_t(p[1]) << 48) |
-           (uint64_t(p[2]) << 40) |
-           (uint64_t(p[3]) << 32) |
-           (uint64_t(p[4]) << 24) |
-           (uint64_t(p[5]) << 16) |
-           (uint64_t(p[6]) << 8)  |
-           uint64_t(p[7]);
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
 }
 
 inline uint64_t load_be(const std::byte* p, be48 encoding) noexcept {
     uint32_t hi = load_be<uint32_t>(p);
-    uint16_t lo = load_be<uint16_t>(p);
+    uint16_t lo = load_be<uint16_t>(p + 4);
     return (uint64_t(hi) << 16) | lo;
 }
 
@@ -162,9 +166,127 @@ inline void parse_impl(
     );
 }
 
+// The message types which make most of the feed are decoded by a shuffle
+// kernel: the fields are laid out in Msg in the order of Layout with their
+// natural alignment, so where every byte of the wire message ends up in the
+// struct, swapped or not, is known at compile time. The message is loaded in
+// 16 byte chunks, the last one ending with the message so nothing past it is
+// read, and every 16 bytes of the struct are one pshufb per chunk they take
+// bytes from, OR-ed together. Bytes no field covers (padding, the top of a
+// 48 bit timestamp) come out zero.
+template<typename Msg>
+inline constexpr bool shuffle_decoded = false;
+
+#ifdef ITCH_SHUFFLE_DECODE
+
+template<typename Layout, typename Msg>
+struct ShuffleKernel {
+    static constexpr size_t fields = std::tuple_size_v<Layout>;
+    static constexpr size_t wire_size = OffsetAt<fields, Layout>::value;
+    static constexpr size_t out_chunks = (sizeof(Msg) + 15) / 16;
+
+    static_assert(wire_size >= 16, "The shuffle kernel needs a message of at least 16 bytes");
+    static_assert(sizeof(Msg) % 16 == 0 || sizeof(Msg) % 16 == 8);
+
+    // chunks at 0, 16, ... and one ending with the message
+    static constexpr size_t in_chunks = (wire_size + 15) / 16;
+
+    static constexpr size_t load_offset(size_t k) {
+        return k + 1 < in_chunks ? k * 16 : wire_size - 16;
+    }
+
+    struct Plan {
+        std::array<std::array<std::array<uint8_t, 16>, in_chunks>, out_chunks> masks{};
+        std::array<std::array<bool, in_chunks>, out_chunks> used{};
+        size_t struct_size = 0;
+    };
+
+    template<size_t I>
+    static constexpr void place(Plan& plan, size_t& dst) {
+        using F = std::tuple_element_t<I, Layout>;
+        using T = typename F::type;
+        constexpr size_t align = alignof(std::remove_extent_t<T>);
+        constexpr bool swap = !std::is_array_v<T> && sizeof(T) > 1;
+
+        dst = (dst + align - 1) / align * align;
+        for (size_t j = 0; j < F::size; ++j) {
+            size_t from = OffsetAt<I, Layout>::value + (swap ? F::size - 1 - j : j);
+            size_t to = dst + j;
+
+            size_t k = from / 16 < in_chunks - 1 ? from / 16 : in_chunks - 1;
+            plan.masks[to / 16][k][to % 16] = uint8_t(from - load_offset(k));
+            plan.used[to / 16][k] = true;
+        }
+        dst += sizeof(T);
+    }
+
+    static constexpr Plan make_plan() {
+        Plan plan;
+        for (auto& out : plan.masks) {
+            for (auto& mask : out) {
+                mask.fill(0x80);
+            }
+        }
+
+        size_t dst = 0;
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (place<I>(plan, dst), ...);
+        }(std::make_index_sequence<fields>{});
+
+        plan.struct_size = (dst + alignof(Msg) - 1) / alignof(Msg) * alignof(Msg);
+        return plan;
+    }
+
+    static constexpr Plan plan = make_plan();
+    static_assert(plan.struct_size == sizeof(Msg), "Msg doesn't follow its layout");
+
+    template<size_t O, size_t... K>
+    static __m128i shuffle_chunk(const __m128i* in, std::index_sequence<K...>) {
+        __m128i out = _mm_setzero_si128();
+        ([&] {
+            if constexpr (plan.used[O][K]) {
+                __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plan.masks[O][K].data()));
+                out = _mm_or_si128(out, _mm_shuffle_epi8(in[K], mask));
+            }
+        }(), ...);
+        return out;
+    }
+
+    static Msg decode(const std::byte* src) {
+        __m128i in[in_chunks];
+        for (size_t k = 0; k < in_chunks; ++k) {
+            in[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + load_offset(k)));
+        }
+
+        // straight into the struct, a bounce buffer copied with wider loads
+        // than its stores defeats store forwarding
+        Msg m;
+        auto* out = reinterpret_cast<std::byte*>(&m);
+        [&]<size_t... O>(std::index_sequence<O...>) {
+            ([&] {
+                __m128i chunk = shuffle_chunk<O>(in, std::make_index_sequence<in_chunks>{});
+                if constexpr (O * 16 + 16 <= sizeof(Msg)) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + O * 16), chunk);
+                } else {
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + O * 16), chunk);
+                }
+            }(), ...);
+        }(std::make_index_sequence<out_chunks>{});
+        return m;
+    }
+};
+
+#endif
+
 template<typename Layout, typename Msg>
 ITCH_HOT
 inline Msg parse_itch(const std::byte* src) {
+#ifdef ITCH_SHUFFLE_DECODE
+    if constexpr (shuffle_decoded<Msg>) {
+        return ShuffleKernel<Layout, Msg>::decode(src);
+    }
+#endif
+
     Msg m;
     parse_impl<Layout, Msg>(
         m,
@@ -179,6 +301,76 @@ inline void parse_and_handle(const std::byte* src, SpecificHandler& handler) {
     handler.handle(parse_itch<Layout, Msg>(src));
 }
 
+template<auto A, auto B>
+consteval bool same_member() {
+    if constexpr (std::is_same_v<decltype(A), decltype(B)>) {
+        return A == B;
+    } else {
+        return false;
+    }
+}
+
+// position of the field of Member in Layout, the size of Layout when absent
+template<auto Member, typename Layout>
+consteval size_t index_of() {
+    return []<size_t... I>(std::index_sequence<I...>) {
+        size_t index = sizeof...(I);
+        ((index = index == sizeof...(I) && same_member<Member, std::tuple_element_t<I, Layout>::member>() ? I : index), ...);
+        return index;
+    }(std::make_index_sequence<std::tuple_size_v<Layout>>{});
+}
+
+// The raw bytes of a message behind the same layout as its struct, a field is
+// only decoded when it is read, from an offset known at compile time. A
+// handler which takes the view of a type gets it instead of the struct, e.g.
+//
+//   void handle(ITCH::MsgView<ITCH::OrderDeleteLayout> msg) {
+//       book(msg.get<&ITCH::OrderDelete::stock_locate>())
+//           .delete_order(msg.get<&ITCH::OrderDelete::order_reference_number>());
+//   }
+//
+// The view points into the packet, it must not outlive the handle call.
+template<typename Layout>
+class MsgView {
+public:
+    using Msg = typename member_pointer_traits<std::remove_cv_t<decltype(std::tuple_element_t<0, Layout>::member)>>::class_type;
+
+    explicit MsgView(const std::byte* src) : src(src) {}
+
+    template<auto Member>
+    auto get() const {
+        constexpr size_t I = index_of<Member, Layout>();
+        static_assert(I < std::tuple_size_v<Layout>, "Member is not in the layout");
+        using F = std::tuple_element_t<I, Layout>;
+        const std::byte* p = src + OffsetAt<I, Layout>::value;
+
+        if constexpr (std::is_array_v<typename F::type>) {
+            return std::string_view(reinterpret_cast<const char*>(p), std::extent_v<typename F::type>);
+        } else if constexpr (std::is_void_v<typename F::encoding>) {
+            return load_be<typename F::type>(p);
+        } else {
+            return load_be(p, typename F::encoding{});
+        }
+    }
+
+    // every field, as parse_itch decodes them
+    Msg decode() const {
+        return parse_itch<Layout, Msg>(src);
+    }
+
+    const std::byte* data() const {
+        return src;
+    }
+
+private:
+    const std::byte* src;
+};
+
+template<typename SpecificHandler, typename Layout>
+inline void view_and_handle(const std::byte* src, SpecificHandler& handler) {
+    handler.handle(MsgView<Layout>(src));
+}
+
 enum class MessageType {
     SYSTEM_EVENT                = 'S',
     STOCK_DIRECTORY             = 'R',
@@ -697,10 +889,45 @@ using DirectListingCapitalRaiseLayout = std::tuple<
     Field<&DirectListingCapitalRaise::upper_price_range_collar>
 >;
 
+template<> inline constexpr bool shuffle_decoded<AddOrderNoMpid> = true;
+template<> inline constexpr bool shuffle_decoded<AddOrderMpid> = true;
+template<> inline constexpr bool shuffle_decoded<OrderExecuted> = true;
+template<> inline constexpr bool shuffle_decoded<OrderCancel> = true;
+template<> inline constexpr bool shuffle_decoded<OrderDelete> = true;
+template<> inline constexpr bool shuffle_decoded<OrderReplace> = true;
+
 class ItchParser {
 public:
+    // the first skip messages of the payload are stepped over, not dispatched
     template <typename SpecificHandler>
-    void parse(std::byte const *  src, size_t len, SpecificHandler& handler);
+    void parse(std::byte const *  src, size_t len, SpecificHandler& handler, uint16_t skip = 0);
+
+    // Parses in two passes: the first one only finds the messages, their type
+    // and locate, prefetching ahead of the scan, the second one dispatches
+    // them. With group_by_type the messages of a pass are dispatched type by
+    // type so the same handler runs back to back, in waves which keep the
+    // payload order of every locate: the n-th message of a locate is in wave
+    // n. A system event ends the pass and is dispatched last, it can apply to
+    // every locate. A handler with prefetch(msg) gets every message of the pass
+    // in between, msg points to the type.
+    template <typename SpecificHandler>
+    void parse_batch(std::byte const * src, size_t len, SpecificHandler& handler, bool group_by_type, uint16_t skip = 0);
+
+private:
+    static std::byte const * skip_messages(std::byte const * src, std::byte const * end, uint16_t count);
+
+    static constexpr size_t batch_capacity = 1024;
+    static constexpr size_t prefetch_distance = 256;
+
+    struct BatchedMsg {
+        const std::byte* msg; // the type, the fields follow
+        uint32_t order;       // wave, type, index, the dispatch order when grouped
+    };
+
+    std::array<BatchedMsg, batch_capacity> batch;
+    std::array<uint32_t, batch_capacity> dispatch_order;
+    // messages of a locate seen in the current pass, reset after it
+    std::array<uint16_t, 65536> locate_waves{};
 };
 
 inline uint16_t load_be16(const std::byte* p) {
@@ -728,6 +955,61 @@ consteval bool is_valid_message_type(uint8_t c) {
     return false;
 }
 
+// What a handler wants to see of the feed, checked on the raw message before
+// anything is decoded: a filter per message type and a bit per stock locate.
+// A type is dropped, delivered for the subscribed locates only or delivered
+// for every locate (system events, the stock directory which brings the
+// locates in the first place). Bytes which are no ITCH type are delivered so
+// the dispatch still rejects them.
+class Subscription {
+public:
+    enum class Filter : uint8_t {
+        Drop,
+        Locate,
+        All
+    };
+
+    Subscription();
+
+    void deliver(char type, Filter filter) {
+        types[uint8_t(type)] = filter;
+    }
+
+    void subscribe(uint16_t locate) {
+        locates[locate >> 6] |= uint64_t(1) << (locate & 63);
+    }
+
+    void unsubscribe(uint16_t locate) {
+        locates[locate >> 6] &= ~(uint64_t(1) << (locate & 63));
+    }
+
+    // msg points to the type, the stock locate follows it on every type
+    bool wants(const std::byte* msg) const {
+        Filter filter = types[uint8_t(msg[0])];
+        if (filter == Filter::Locate) {
+            uint16_t locate = load_be16(msg + 1);
+            return (locates[locate >> 6] >> (locate & 63)) & 1;
+        }
+        return filter == Filter::All;
+    }
+
+private:
+    std::array<Filter, 256> types;
+    std::array<uint64_t, 65536 / 64> locates{};
+
+    static consteval std::array<Filter, 256> initial_types();
+};
+
+consteval std::array<Subscription::Filter, 256> Subscription::initial_types() {
+    std::array<Filter, 256> filters{};
+    for (int i = 0; i < 256; ++i) {
+        filters[i] = is_valid_message_type(i) ? Filter::Drop : Filter::All;
+    }
+    return filters;
+}
+
+inline Subscription::Subscription() : types(initial_types()) {}
+
 template<typename SpecificHandler, typename Msg>
 concept HasHandle =
     requires(SpecificHandler& h, const Msg& m) {
@@ -747,7 +1029,9 @@ consteval std::array<ParseFn<SpecificHandler>, 256> make_dispatch() {
     }
 
     #define X(RAW_TYPE, TYPE) \
-        if constexpr (HasHandle<SpecificHandler, TYPE>) { \
+        if constexpr (HasHandle<SpecificHandler, MsgView<TYPE##Layout>>) { \
+            table[static_cast<uint8_t>(RAW_TYPE)] = &view_and_handle<SpecificHandler, TYPE##Layout>; \
+        } else if constexpr (HasHandle<SpecificHandler, TYPE>) { \
             table[static_cast<uint8_t>(RAW_TYPE)] = &parse_and_handle<SpecificHandler, TYPE##Layout, TYPE>; \
         } \
 
@@ -760,9 +1044,24 @@ consteval std::array<ParseFn<SpecificHandler>, 256> make_dispatch() {
 template<typename SpecificHandler>
 alignas(64) inline constexpr auto dispatch = make_dispatch<SpecificHandler>();
 
+// a packet cut short ends the skip like it ends the parse
+inline std::byte const * ItchParser::skip_messages(std::byte const * src, std::byte const * end, uint16_t count) {
+    for (; count != 0 && end - src >= 3; --count) {
+        uint16_t size = load_be16(src);
+        if (end - src < 2 + size) {
+            return end;
+        }
+        src += 2 + size;
+    }
+    return src;
+}
+
 template<typename SpecificHandler>
-void ItchParser::parse(std::byte const * src, size_t len, SpecificHandler& handler) {
+void ItchParser::parse(std::byte const * src, size_t len, SpecificHandler& handler, uint16_t skip) {
     std::byte const * end = src + len;
+    if (skip != 0) [[unlikely]] {
+        src = skip_messages(src, end, skip);
+    }
 
     while (end - src >= 3) {
         uint16_t size = load_be16(src);
@@ -771,18 +1070,112 @@ void ItchParser::parse(std::byte const * src, size_t len, SpecificHandler& handl
         }
         src += 2;
 
+        // a handler with a subscription never sees, not even times, the
+        // messages of the other instruments
+        if constexpr (requires { handler.subscription(); }) {
+            if (!handler.subscription().wants(src)) {
+                src += size;
+                continue;
+            }
+        }
+
         auto raw_type = char(src[0]);
         src += 1;
 
-        handler.handle_before();
+        if constexpr (requires { handler.handle_before(); }) {
+            handler.handle_before();
+        }
         dispatch<SpecificHandler>[raw_type](src, handler);
-        handler.handle_after();
+        if constexpr (requires { handler.handle_after(); }) {
+            handler.handle_after();
+        }
 
         src += size - 1;
     }
 }
 
+template<typename SpecificHandler>
+void ItchParser::parse_batch(std::byte const * src, size_t len, SpecificHandler& handler, bool group_by_type, uint16_t skip) {
+    std::byte const * end = src + len;
+    if (skip != 0) [[unlikely]] {
+        src = skip_messages(src, end, skip);
+    }
+
+    while (end - src >= 3) {
+        size_t count = 0;
+
+        // pass one: the message boundaries. The next length depends on the
+        // previous one, what can run ahead is the prefetch of the payload
+        while (count < batch_capacity && end - src >= 3) {
+            uint16_t size = load_be16(src);
+            if (end - src < 2 + size) {
+                src = end;
+                break;
+            }
+
+            __builtin_prefetch(src + prefetch_distance);
+            const std::byte* msg = src + 2;
+            src += 2 + size;
+
+            if constexpr (requires { handler.subscription(); }) {
+                if (!handler.subscription().wants(msg)) {
+                    continue;
+                }
+            }
+
+            uint32_t type = uint8_t(msg[0]);
+            if (!group_by_type) {
+                batch[count++] = { msg, 0 };
+                continue;
+            }
+
+            if (type == 'S') {
+                batch[count] = { msg, (uint32_t(batch_capacity - 1) << 18) | (type << 10) | uint32_t(count) };
+                count++;
+                break;
+            }
+
+            uint16_t locate = load_be16(msg + 1);
+            uint32_t wave = locate_waves[locate]++;
+            batch[count] = { msg, (wave << 18) | (type << 10) | uint32_t(count) };
+            count++;
+        }
+
+        // the messages are known now, a handler can start the memory accesses
+        // of all of them before the first one is applied
+        if constexpr (requires { handler.prefetch(src); }) {
+            for (size_t i = 0; i < count; ++i) {
+                handler.prefetch(batch[i].msg);
+            }
+        }
+
+        // pass two: dispatch, in payload order or by wave and type
+        if (group_by_type) {
+            for (size_t i = 0; i < count; ++i) {
+                dispatch_order[i] = batch[i].order;
+                if (batch[i].msg[0] != std::byte('S')) {
+                    locate_waves[load_be16(batch[i].msg + 1)] = 0;
+                }
+            }
+            std::sort(dispatch_order.begin(), dispatch_order.begin() + count);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            const std::byte* msg = group_by_type ? batch[dispatch_order[i] & (batch_capacity - 1)].msg : batch[i].msg;
+
+            if constexpr (requires { handler.handle_before(); }) {
+                handler.handle_before();
+            }
+            dispatch<SpecificHandler>[uint8_t(msg[0])](msg + 1, handler);
+            if constexpr (requires { handler.handle_after(); }) {
+                handler.handle_after();
+            }
+        }
+    }
+}
+
 #undef ITCH_MESSAGE_LIST
+#undef ITCH_SHUFFLE_DECODE
 #undef ITCH_COLD
 #undef ITCH_HOT
 
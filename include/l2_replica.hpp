@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include "depth_snapshot.hpp"
+#include "order_book_shared.hpp"
+#include "levels/vector_levels_b_search_split.hpp"
+
+namespace OB {
+
+enum class LevelEvent : uint8_t {
+    New,
+    Update,
+    Removed
+};
+
+// Consumer side copy of the levels of one book, kept up to date from the
+// LevelDeltas the handler publishes, without orders or order ids. The levels
+// live in the same kind of store as in the book, so the replica answers the
+// same best and depth queries as the book it follows.
+template<template<Side> typename Levels = VectorLevelBSearchSplit>
+class L2Replica {
+public:
+    // what the delta did to its level
+    LevelEvent apply(const LevelDelta& delta);
+
+    Level best_bid() const {
+        return bid_levels.best();
+    }
+
+    Level best_ask() const {
+        return ask_levels.best();
+    }
+
+    template<size_t N>
+    DepthSnapshot<N> depth() const {
+        DepthSnapshot<N> snapshot;
+        fill_depth(bid_levels, snapshot.bid);
+        fill_depth(ask_levels, snapshot.ask);
+        return snapshot;
+    }
+
+    Levels<Side::Bid> bid_levels;
+    Levels<Side::Ask> ask_levels;
+
+private:
+    template<Side S>
+    static LevelEvent apply_side(Levels<S>& levels, const LevelDelta& delta);
+};
+
+template<template<Side> typename Levels>
+template<Side S>
+inline LevelEvent L2Replica<Levels>::apply_side(Levels<S>& levels, const LevelDelta& delta) {
+    const size_t depth = levels.size();
+    LevelHandle handle;
+
+    if (delta.qty > 0) {
+        levels.add({uint64_t(delta.qty), delta.price, uint32_t(delta.orders > 0)}, handle);
+        return levels.size() != depth ? LevelEvent::New : LevelEvent::Update;
+    }
+
+    UNEXPECTED(!levels.find(delta.price, handle), "Level delta for a missing level");
+    if (delta.orders < 0) {
+        order_left(levels, handle);
+    }
+    levels.remove(handle, uint64_t(-delta.qty));
+
+    return levels.size() != depth ? LevelEvent::Removed : LevelEvent::Update;
+}
+
+template<template<Side> typename Levels>
+inline LevelEvent L2Replica<Levels>::apply(const LevelDelta& delta) {
+    if (delta.side == Side::Bid) {
+        return apply_side(bid_levels, delta);
+    } else {
+        return apply_side(ask_levels, delta);
+    }
+}
+
+}
@@ -0,0 +1,406 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "depth_snapshot.hpp"
+#include "order_book_shared.hpp"
+#include "orders/hash_order_table.hpp"
+
+namespace OB {
+
+// Order by order (L3) counterpart of OrderBook. The level stores aggregate qty
+// per price exactly like in OrderBook and on top of that every level keeps its
+// orders in an intrusive FIFO in time priority, so strategies can ask for the
+// order count of a level, the order at the front of it and the queue position
+// of an order.
+//
+// Orders come from a pooled arena and are addressed by index. The part written
+// when linking and unlinking (prev, next, qty, level) is 16 bytes, so four
+// orders share a cache line, while the id, timestamp and price are only read
+// by the queries and live in separate arrays.
+
+inline constexpr uint32_t L3_NIL = UINT32_MAX;
+
+struct L3Order {
+    uint32_t prev;
+    uint32_t next;
+    uint32_t qty;
+    LevelHandle level;
+};
+
+static_assert(sizeof(L3Order) == 16);
+
+// what the order table keeps per order id for an L3 book
+struct L3OrderRef {
+    uint32_t node;
+    Side side;
+};
+
+struct L3OrderInfo {
+    uint64_t order_id;
+    uint64_t timestamp;
+    uint32_t qty;
+    uint32_t price;
+    Side side;
+};
+
+struct QueuePosition {
+    uint32_t orders_ahead;
+    uint64_t qty_ahead;
+};
+
+struct L3LevelQueue {
+    uint32_t head = L3_NIL;
+    uint32_t tail = L3_NIL;
+    uint32_t count = 0;
+};
+
+class L3OrderPool {
+public:
+    explicit L3OrderPool(size_t capacity = 1 << 16) {
+        nodes.reserve(capacity);
+        order_ids.reserve(capacity);
+        timestamps.reserve(capacity);
+        prices.reserve(capacity);
+    }
+
+    uint32_t acquire();
+    void release(uint32_t node);
+
+    std::vector<L3Order> nodes;
+    std::vector<uint64_t> order_ids;
+    std::vector<uint64_t> timestamps;
+    std::vector<uint32_t> prices;
+
+private:
+    // released nodes are chained through L3Order::next
+    uint32_t free_head = L3_NIL;
+};
+
+inline uint32_t L3OrderPool::acquire() {
+    if (free_head != L3_NIL) {
+        uint32_t node = free_head;
+        free_head = nodes[node].next;
+        return node;
+    }
+
+    nodes.emplace_back();
+    order_ids.emplace_back();
+    timestamps.emplace_back();
+    prices.emplace_back();
+    return nodes.size() - 1;
+}
+
+inline void L3OrderPool::release(uint32_t node) {
+    nodes[node].next = free_head;
+    free_head = node;
+}
+
+template<template<Side> typename Levels, typename Orders = HashOrderTable<L3OrderRef>>
+class L3OrderBook {
+public:
+    BestLvlChange add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price, uint64_t timestamp = 0);
+    BestLvlChange cancel_order(uint64_t order_id, uint32_t qty);
+    BestLvlChange execute_order(uint64_t order_id, uint32_t qty);
+    BestLvlChange replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price, uint64_t timestamp = 0);
+    BestLvlChange delete_order(uint64_t order_id);
+
+    Level best_bid();
+    Level best_ask();
+
+    uint32_t order_count(Side side, uint32_t price);
+
+    template<size_t N>
+    DepthSnapshot<N> depth() const;
+    L3OrderInfo front(Side side, uint32_t price);
+    L3OrderInfo order(uint64_t order_id);
+    // empty once the order left the book (filled, cancelled or replaced)
+    std::optional<QueuePosition> queue_position(uint64_t order_id);
+
+    // issued ahead of the operation on order_id, see Handler::prefetch
+    void prefetch_order(uint64_t order_id) const {
+        orders_map.prefetch(order_id);
+    }
+
+    uint64_t max_orders = 0;
+    Orders orders_map;
+    Levels<Side::Bid> bid_levels;
+    Levels<Side::Ask> ask_levels;
+
+private:
+    BestLvlChange reduce_order(uint64_t order_id, uint32_t qty);
+    BestLvlChange remove_level_qty(Side side, LevelHandle level, uint32_t qty);
+
+    L3LevelQueue& level_queue(Side side, LevelHandle level);
+    bool find_level(Side side, uint32_t price, LevelHandle& level);
+    L3OrderInfo info(uint32_t node, Side side) const;
+
+    template<size_t N, typename L>
+    void fill_order_counts(const L& levels, const std::vector<L3LevelQueue>& queues, DepthSide<N>& side) const;
+
+    void link_back(Side side, uint32_t node);
+    void unlink(Side side, uint32_t node);
+
+    L3OrderPool pool;
+    std::vector<L3LevelQueue> bid_queues;
+    std::vector<L3LevelQueue> ask_queues;
+};
+
+template<template<Side> typename Levels, typename Orders>
+Level L3OrderBook<Levels, Orders>::best_bid() {
+    return bid_levels.best();
+}
+
+template<template<Side> typename Levels, typename Orders>
+Level L3OrderBook<Levels, Orders>::best_ask() {
+    return ask_levels.best();
+}
+
+template<template<Side> typename Levels, typename Orders>
+inline L3LevelQueue& L3OrderBook<Levels, Orders>::level_queue(Side side, LevelHandle level) {
+    auto& queues = side == Side::Bid ? bid_queues : ask_queues;
+    if (level >= queues.size()) [[unlikely]] {
+        queues.resize(level + 1);
+    }
+
+    return queues[level];
+}
+
+template<template<Side> typename Levels, typename Orders>
+inline void L3OrderBook<Levels, Orders>::link_back(Side side, uint32_t node) {
+    L3Order& order = pool.nodes[node];
+    L3LevelQueue& queue = level_queue(side, order.level);
+
+    order.prev = queue.tail;
+    order.next = L3_NIL;
+
+    if (queue.tail != L3_NIL) {
+        pool.nodes[queue.tail].next = node;
+    } else {
+        queue.head = node;
+    }
+
+    queue.tail = node;
+    queue.count++;
+}
+
+template<template<Side> typename Levels, typename Orders>
+inline void L3OrderBook<Levels, Orders>::unlink(Side side, uint32_t node) {
+    L3Order& order = pool.nodes[node];
+    L3LevelQueue& queue = level_queue(side, order.level);
+
+    if (order.prev != L3_NIL) {
+        pool.nodes[order.prev].next = order.next;
+    } else {
+        queue.head = order.next;
+    }
+
+    if (order.next != L3_NIL) {
+        pool.nodes[order.next].prev = order.prev;
+    } else {
+        queue.tail = order.prev;
+    }
+
+    queue.count--;
+}
+
+template<template<Side> typename Levels, typename Orders>
+inline BestLvlChange L3OrderBook<Levels, Orders>::remove_level_qty(Side side, LevelHandle level, uint32_t qty) {
+    if (side == Side::Bid) {
+        return bid_levels.remove(level, qty);
+    } else {
+        return ask_levels.remove(level, qty);
+    }
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange L3OrderBook<Levels, Orders>::add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price, uint64_t timestamp) {
+    uint32_t node = pool.acquire();
+    L3Order& order = pool.nodes[node];
+    order.qty = qty;
+
+    pool.order_ids[node] = order_id;
+    pool.timestamps[node] = timestamp;
+    pool.prices[node] = price;
+
+    BestLvlChange best_lvl_change;
+    if (side == Side::Bid) {
+        best_lvl_change = bid_levels.add({qty, price}, order.level);
+    } else {
+        best_lvl_change = ask_levels.add({qty, price}, order.level);
+    }
+
+    link_back(side, node);
+    orders_map.insert(order_id, {node, side});
+
+    return best_lvl_change;
+}
+
+// partial cancels and executions keep the time priority of the order
+template<template<Side> typename Levels, typename Orders>
+inline BestLvlChange L3OrderBook<Levels, Orders>::reduce_order(uint64_t order_id, uint32_t qty) {
+    L3OrderRef* ref = orders_map.find(order_id);
+    UNEXPECTED(ref == nullptr, "Reduce order did not find an order");
+
+    uint32_t node = ref->node;
+    Side side = ref->side;
+    L3Order& order = pool.nodes[node];
+    UNEXPECTED(order.qty < qty, "Partial reduce order volume greater than order volume");
+
+    BestLvlChange best_lvl_change = remove_level_qty(side, order.level, qty);
+
+    order.qty -= qty;
+    if (order.qty == 0) {
+        unlink(side, node);
+        pool.release(node);
+        orders_map.erase(order_id);
+    }
+
+    return best_lvl_change;
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange L3OrderBook<Levels, Orders>::cancel_order(uint64_t order_id, uint32_t qty) {
+    return reduce_order(order_id, qty);
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange L3OrderBook<Levels, Orders>::execute_order(uint64_t order_id, uint32_t qty) {
+    return reduce_order(order_id, qty);
+}
+
+// a replaced order loses its time priority and goes to the back of its new level
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange L3OrderBook<Levels, Orders>::replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price, uint64_t timestamp) {
+    L3OrderRef* ref = orders_map.find(order_id);
+    UNEXPECTED(ref == nullptr, "Replace order did not find an order");
+
+    uint32_t old_node = ref->node;
+    Side side = ref->side;
+    L3Order& old_order = pool.nodes[old_node];
+
+    BestLvlChange best_change_rem = remove_level_qty(side, old_order.level, old_order.qty);
+    unlink(side, old_node);
+    pool.release(old_node);
+    orders_map.erase(order_id);
+
+    BestLvlChange best_change_add = add_order(new_order_id, side, qty, price, timestamp);
+
+    if (best_change_add.side != Side::None) {
+        return best_change_add;
+    } else return best_change_rem;
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange L3OrderBook<Levels, Orders>::delete_order(uint64_t order_id) {
+    L3OrderRef* ref = orders_map.find(order_id);
+    UNEXPECTED(ref == nullptr, "Delete order did not find an order");
+
+    uint32_t node = ref->node;
+    Side side = ref->side;
+    L3Order& order = pool.nodes[node];
+
+    BestLvlChange best_lvl_change = remove_level_qty(side, order.level, order.qty);
+
+    unlink(side, node);
+    pool.release(node);
+    orders_map.erase(order_id);
+
+    return best_lvl_change;
+}
+
+template<template<Side> typename Levels, typename Orders>
+inline bool L3OrderBook<Levels, Orders>::find_level(Side side, uint32_t price, LevelHandle& level) {
+    if (side == Side::Bid) {
+        return bid_levels.find(price, level);
+    } else {
+        return ask_levels.find(price, level);
+    }
+}
+
+template<template<Side> typename Levels, typename Orders>
+inline L3OrderInfo L3OrderBook<Levels, Orders>::info(uint32_t node, Side side) const {
+    return {
+        .order_id = pool.order_ids[node],
+        .timestamp = pool.timestamps[node],
+        .qty = pool.nodes[node].qty,
+        .price = pool.prices[node],
+        .side = side
+    };
+}
+
+template<template<Side> typename Levels, typename Orders>
+uint32_t L3OrderBook<Levels, Orders>::order_count(Side side, uint32_t price) {
+    LevelHandle level;
+    if (!find_level(side, price, level)) {
+        return 0;
+    }
+
+    return level_queue(side, level).count;
+}
+
+// the level stores only aggregate qty, the order counts come from the queues
+template<template<Side> typename Levels, typename Orders>
+template<size_t N, typename L>
+void L3OrderBook<Levels, Orders>::fill_order_counts(const L& levels, const std::vector<L3LevelQueue>& queues, DepthSide<N>& side) const {
+    for (uint32_t i = 0; i < side.count; ++i) {
+        LevelHandle level;
+        bool found = levels.find(side.prices[i], level);
+        side.orders[i] = found && level < queues.size() ? queues[level].count : 0;
+    }
+}
+
+template<template<Side> typename Levels, typename Orders>
+template<size_t N>
+DepthSnapshot<N> L3OrderBook<Levels, Orders>::depth() const {
+    DepthSnapshot<N> snapshot;
+    fill_depth(bid_levels, snapshot.bid);
+    fill_depth(ask_levels, snapshot.ask);
+    fill_order_counts(bid_levels, bid_queues, snapshot.bid);
+    fill_order_counts(ask_levels, ask_queues, snapshot.ask);
+    return snapshot;
+}
+
+// order_id and side of the result are 0 and Side::None if the level is empty
+template<template<Side> typename Levels, typename Orders>
+L3OrderInfo L3OrderBook<Levels, Orders>::front(Side side, uint32_t price) {
+    LevelHandle level;
+    if (!find_level(side, price, level)) {
+        return {};
+    }
+
+    return info(level_queue(side, level).head, side);
+}
+
+template<template<Side> typename Levels, typename Orders>
+L3OrderInfo L3OrderBook<Levels, Orders>::order(uint64_t order_id) {
+    L3OrderRef* ref = orders_map.find(order_id);
+    if (ref == nullptr) {
+        return {};
+    }
+
+    return info(ref->node, ref->side);
+}
+
+// walks the level from the front, this is meant for strategy queries and not
+// for the ingest path. An order which is gone is no error for a strategy, it
+// may have been filled a moment ago
+template<template<Side> typename Levels, typename Orders>
+std::optional<QueuePosition> L3OrderBook<Levels, Orders>::queue_position(uint64_t order_id) {
+    L3OrderRef* ref = orders_map.find(order_id);
+    if (ref == nullptr) {
+        return std::nullopt;
+    }
+
+    L3LevelQueue& queue = level_queue(ref->side, pool.nodes[ref->node].level);
+    QueuePosition position{0, 0};
+
+    for (uint32_t node = queue.head; node != ref->node; node = pool.nodes[node].next) {
+        position.orders_ahead++;
+        position.qty_ahead += pool.nodes[node].qty;
+    }
+
+    return position;
+}
+
+}
@@ -7,13 +7,32 @@
 
 namespace OB {
 
+// the handle of a level is its price. Prices from N up are left out of the
+// levels and counted, like in BitmapLevels
 template<Side S>
 class ArrayLevelsV2 {
 public:
-    void add(Level level);
-    void remove(Level level);
+    static constexpr uint32_t N = 1 << 21; // prices up to 209.7152
+
+    BestLvlChange add(Level level, LevelHandle& handle);
+    BestLvlChange remove(LevelHandle handle, uint64_t qty);
     Level best();
 
+    size_t copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const;
+
+    LevelHandle best_handle() const {
+        return best_idx;
+    }
+
+    bool find(uint32_t price, LevelHandle& handle) const {
+        if (price >= N || book[price] == 0) {
+            return false;
+        }
+
+        handle = price;
+        return true;
+    }
+
     // define the copy and move ops...
 
     ArrayLevelsV2() : book(static_cast<uint64_t*>(std::aligned_alloc(64, N * sizeof(uint64_t)))) {
@@ -25,41 +44,65 @@ public:
         std::free(book);
     }
 
+    // adds which were left out, their price was N or more
+    uint64_t out_of_range = 0;
+
 private:
-    static constexpr int N = 2'000'000;
+    BestLvlChange best_change();
+
     uint64_t* book;
     uint32_t best_idx = 0;
 };
 
 template<Side S>
-inline void ArrayLevelsV2<S>::add(Level level) {
-    if (level.price > N) {
-        return;
+inline BestLvlChange ArrayLevelsV2<S>::best_change() {
+    auto qty = book[best_idx];
+    return BestLvlChange{
+        .qty = qty,
+        .price = qty != 0 ? best_idx : 0,
+        .side = S
+    };
+}
+
+template<Side S>
+inline BestLvlChange ArrayLevelsV2<S>::add(Level level, LevelHandle& handle) {
+    handle = level.price;
+    if (level.price >= N) [[unlikely]] {
+        out_of_range++;
+        return BestLvlChange{};
     }
 
     book[level.price] += level.qty;
     if constexpr (S == Side::Bid) {
-        if (level.price > best_idx) {
+        if (level.price >= best_idx) {
             best_idx = level.price;
+            return best_change();
         }
     } else {
-        if (level.price < best_idx) {
+        if (level.price <= best_idx) {
             best_idx = level.price;
+            return best_change();
         }
     }
+
+    return BestLvlChange{};
 }
 
 template<Side S>
-inline void ArrayLevelsV2<S>::remove(Level level) {
-    if (level.price > N) {
-        return;
+inline BestLvlChange ArrayLevelsV2<S>::remove(LevelHandle handle, uint64_t qty) {
+    if (handle >= N) [[unlikely]] {
+        return BestLvlChange{};
     }
 
-    auto& qty = book[level.price];
-    UNEXPECTED(level.qty > qty, "Remove underflow");
+    auto& level_qty = book[handle];
+    UNEXPECTED(qty > level_qty, "Remove underflow");
+
+    level_qty -= qty;
+    if (handle != best_idx) {
+        return BestLvlChange{};
+    }
 
-    qty -= level.qty;
-    if (qty == 0 && level.price == best_idx) {
+    if (level_qty == 0) {
         if constexpr (S == Side::Bid) {
             while (best_idx > 0 && book[best_idx] == 0) {
                 best_idx--;
@@ -70,6 +113,8 @@ inline void ArrayLevelsV2<S>::remove(Level level) {
             }
         }
     }
+
+    return best_change();
 }
 
 template<Side S>
@@ -78,4 +123,23 @@ inline Level ArrayLevelsV2<S>::best() {
     return {qty, best_idx};
 }
 
+
+// scans the dense ladder away from the best price, one slot per tick
+template<Side S>
+inline size_t ArrayLevelsV2<S>::copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const {
+    size_t count = 0;
+    for (int64_t idx = best_idx; count < n && idx >= 0 && idx < int64_t(N); idx += S == Side::Bid ? -1 : 1) {
+        if (book[idx] == 0) {
+            continue;
+        }
+
+        out_qtys[count] = book[idx];
+        out_prices[count] = uint32_t(idx);
+        out_orders[count] = 0;
+        count++;
+    }
+
+    return count;
+}
+
 }
@@ -0,0 +1,186 @@
+#pragma once
+#include <cstdint>
+#include <sys/mman.h>
+#include "order_book_shared.hpp"
+#include "levels/occupancy_bitmap.hpp"
+
+namespace OB {
+
+// Same dense qty array indexed by price as ArrayLevelsV2, but the occupied
+// prices are also tracked in a hierarchical bitmap. When the best level
+// empties the next one is found with a few lzcnt/tzcnt instead of a linear
+// scan over the empty slots in between. The handle of a level is its price.
+//
+// The qty array is mapped with MAP_NORESERVE instead of being memset, only
+// the pages around the traded prices get committed.
+//
+// Prices from N up don't fit the ladder. Like ArrayLevelsV2 the store leaves
+// them out of the levels instead of aborting, and counts them.
+
+template<Side S>
+class BitmapLevels {
+public:
+    static constexpr uint32_t N = 1 << 21; // prices up to 209.7152
+
+    BitmapLevels() {
+        void* mem = mmap(nullptr, N * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        UNEXPECTED(mem == MAP_FAILED, "BitmapLevels mmap failed");
+        qtys = static_cast<uint64_t*>(mem);
+    }
+
+    ~BitmapLevels() {
+        munmap(qtys, N * sizeof(uint64_t));
+    }
+
+    BitmapLevels(const BitmapLevels&) = delete;
+    BitmapLevels& operator=(const BitmapLevels&) = delete;
+
+    BestLvlChange add(Level level, LevelHandle& handle);
+    BestLvlChange remove(LevelHandle handle, uint64_t qty);
+
+    Level best() const;
+    LevelHandle best_handle() const;
+    bool find(uint32_t price, LevelHandle& handle) const;
+
+    size_t copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const;
+
+    // adds which were left out, their price was N or more
+    uint64_t out_of_range = 0;
+
+private:
+    static constexpr uint32_t no_level = UINT32_MAX;
+
+    BestLvlChange best_change() const;
+
+    uint64_t* qtys;
+    OccupancyBitmap<N> occupied;
+    uint32_t best_idx = no_level;
+};
+
+template<Side S>
+inline BestLvlChange BitmapLevels<S>::best_change() const {
+    if (best_idx == no_level) {
+        return BestLvlChange{
+            .qty = 0,
+            .price = 0,
+            .side = S
+        };
+    }
+
+    return BestLvlChange{
+        .qty = qtys[best_idx],
+        .price = best_idx,
+        .side = S
+    };
+}
+
+template<Side S>
+inline BestLvlChange BitmapLevels<S>::add(Level level, LevelHandle& handle) {
+    handle = level.price;
+    if (level.price >= N) [[unlikely]] {
+        out_of_range++;
+        return BestLvlChange{};
+    }
+
+    uint64_t& qty = qtys[level.price];
+    if (qty == 0) {
+        occupied.set(level.price);
+    }
+    qty += level.qty;
+
+    bool best_changed;
+    if constexpr (S == Side::Bid) {
+        best_changed = best_idx == no_level || level.price >= best_idx;
+    } else {
+        best_changed = level.price <= best_idx;
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    best_idx = level.price;
+    return best_change();
+}
+
+template<Side S>
+inline BestLvlChange BitmapLevels<S>::remove(LevelHandle handle, uint64_t qty) {
+    if (handle >= N) [[unlikely]] {
+        return BestLvlChange{};
+    }
+
+    uint64_t& level_qty = qtys[handle];
+    UNEXPECTED(qty > level_qty, "Remove underflow");
+
+    bool best_changed = handle == best_idx;
+
+    level_qty -= qty;
+    if (level_qty == 0) {
+        occupied.clear(handle);
+
+        if (best_changed) {
+            uint64_t next;
+            if constexpr (S == Side::Bid) {
+                next = handle == 0 ? occupied.npos : occupied.prev(handle - 1);
+            } else {
+                next = handle + 1 == N ? occupied.npos : occupied.next(handle + 1);
+            }
+            best_idx = next == occupied.npos ? no_level : uint32_t(next);
+        }
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    return best_change();
+}
+
+template<Side S>
+inline Level BitmapLevels<S>::best() const {
+    if (best_idx == no_level) {
+        return {0, 0};
+    }
+
+    return {qtys[best_idx], best_idx};
+}
+
+template<Side S>
+inline LevelHandle BitmapLevels<S>::best_handle() const {
+    UNEXPECTED(best_idx == no_level, "Best handle on an empty side");
+    return best_idx;
+}
+
+template<Side S>
+inline bool BitmapLevels<S>::find(uint32_t price, LevelHandle& handle) const {
+    if (price >= N || qtys[price] == 0) {
+        return false;
+    }
+
+    handle = price;
+    return true;
+}
+
+
+template<Side S>
+inline size_t BitmapLevels<S>::copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const {
+    size_t count = 0;
+    uint64_t idx = best_idx == no_level ? occupied.npos : best_idx;
+    while (count < n && idx != occupied.npos) {
+        out_qtys[count] = qtys[idx];
+        out_prices[count] = uint32_t(idx);
+        out_orders[count] = 0;
+        count++;
+
+        if constexpr (S == Side::Bid) {
+            idx = idx == 0 ? occupied.npos : occupied.prev(idx - 1);
+        } else {
+            idx = idx + 1 == N ? occupied.npos : occupied.next(idx + 1);
+        }
+    }
+
+    return count;
+}
+
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "depth_snapshot.hpp"
+#include "order_book_shared.hpp"
+#include "levels/level_arena.hpp"
+#include "levels/near_touch_search.hpp"
+
+namespace OB {
+
+// Memory lean level store for subscribing to the whole market, where most of
+// the books are a handful of levels deep. Prices and qtys are kept sorted with
+// the best price at the back like in VectorLevelBSearchSplit, but the first
+// inline_capacity levels live inside the object and the arrays only move to
+// the session arena, doubling their size, when the depth asks for it.
+//
+// The handle of a level is its price. Removing a level searches for it from
+// the back, which is where the short books and the touch of the deep ones are.
+template<Side S>
+class CompactLevels {
+public:
+    static constexpr uint32_t inline_capacity = 6;
+
+    CompactLevels() {
+        session_level_arena(); // the arena has to outlive the books
+    }
+
+    ~CompactLevels() {
+        if (prices != inline_prices) {
+            session_level_arena().release(qtys, bytes(capacity));
+        }
+    }
+
+    // the arrays point into the object itself
+    CompactLevels(const CompactLevels&) = delete;
+    CompactLevels& operator=(const CompactLevels&) = delete;
+
+    BestLvlChange add(Level level, LevelHandle& handle);
+    BestLvlChange remove(LevelHandle handle, uint64_t qty);
+
+    Level best() const;
+    LevelHandle best_handle() const;
+    bool find(uint32_t price, LevelHandle& handle) const;
+
+    size_t size() const {
+        return count;
+    }
+
+    // visits every level, from the worst price to the best one
+    template<typename F>
+    void for_each(F&& f) const {
+        for (uint32_t i = 0; i < count; ++i) {
+            f(Level{qtys[i], prices[i]});
+        }
+    }
+
+    size_t copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const {
+        n = std::min<size_t>(n, count);
+        copy_reversed(out_prices, prices + count - n, n);
+        copy_reversed(out_qtys, qtys + count - n, n);
+        std::fill(out_orders, out_orders + n, 0);
+        return n;
+    }
+
+    // arena memory of all the compact books of the session
+    static size_t arena_bytes() {
+        return session_level_arena().used_bytes();
+    }
+
+private:
+    static size_t bytes(uint32_t capacity) {
+        return size_t(capacity) * (sizeof(uint64_t) + sizeof(uint32_t));
+    }
+
+    [[gnu::cold, gnu::noinline]] void grow();
+    BestLvlChange best_change() const;
+
+    uint32_t* prices = inline_prices;
+    uint64_t* qtys = inline_qtys;
+    uint32_t count = 0;
+    uint32_t capacity = inline_capacity;
+
+    uint32_t inline_prices[inline_capacity];
+    uint64_t inline_qtys[inline_capacity];
+};
+
+template<Side S>
+void CompactLevels<S>::grow() {
+    LevelArena& arena = session_level_arena();
+
+    size_t block = LevelArena::block_size(bytes(capacity * 2));
+    uint32_t new_capacity = uint32_t(block / (sizeof(uint64_t) + sizeof(uint32_t)));
+
+    // the qtys go first in the block to keep them 8 byte aligned
+    auto* new_qtys = static_cast<uint64_t*>(arena.allocate(block));
+    auto* new_prices = reinterpret_cast<uint32_t*>(new_qtys + new_capacity);
+    std::memcpy(new_qtys, qtys, count * sizeof(uint64_t));
+    std::memcpy(new_prices, prices, count * sizeof(uint32_t));
+
+    if (prices != inline_prices) {
+        arena.release(qtys, bytes(capacity));
+    }
+
+    qtys = new_qtys;
+    prices = new_prices;
+    capacity = new_capacity;
+}
+
+template<Side S>
+inline BestLvlChange CompactLevels<S>::best_change() const {
+    if (count == 0) {
+        return BestLvlChange{
+            .qty = 0,
+            .price = 0,
+            .side = S
+        };
+    }
+
+    return BestLvlChange{
+        .qty = qtys[count - 1],
+        .price = prices[count - 1],
+        .side = S
+    };
+}
+
+template<Side S>
+inline BestLvlChange CompactLevels<S>::add(Level level, LevelHandle& handle) {
+    handle = level.price;
+
+    size_t idx = near_touch_idx<S>(prices, count, level.price);
+    bool found = idx != count && prices[idx] == level.price;
+    bool best_changed = idx == count || (found && idx + 1 == count);
+
+    if (found) {
+        qtys[idx] += level.qty;
+    } else {
+        if (count == capacity) [[unlikely]] {
+            grow();
+        }
+
+        std::memmove(prices + idx + 1, prices + idx, (count - idx) * sizeof(uint32_t));
+        std::memmove(qtys + idx + 1, qtys + idx, (count - idx) * sizeof(uint64_t));
+        prices[idx] = level.price;
+        qtys[idx] = level.qty;
+        count++;
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    return best_change();
+}
+
+template<Side S>
+inline BestLvlChange CompactLevels<S>::remove(LevelHandle handle, uint64_t qty) {
+    size_t idx = near_touch_idx<S>(prices, count, handle);
+    UNEXPECTED(idx == count || prices[idx] != handle, "Remove didn't find a level");
+    UNEXPECTED(qty > qtys[idx], "Remove underflow");
+
+    bool best_changed = idx + 1 == count;
+
+    qtys[idx] -= qty;
+    if (qtys[idx] == 0) {
+        std::memmove(prices + idx, prices + idx + 1, (count - idx - 1) * sizeof(uint32_t));
+        std::memmove(qtys + idx, qtys + idx + 1, (count - idx - 1) * sizeof(uint64_t));
+        count--;
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    return best_change();
+}
+
+template<Side S>
+inline Level CompactLevels<S>::best() const {
+    if (count == 0) {
+        return {0, 0};
+    }
+
+    return {qtys[count - 1], prices[count - 1]};
+}
+
+template<Side S>
+inline LevelHandle CompactLevels<S>::best_handle() const {
+    UNEXPECTED(count == 0, "Best handle on an empty side");
+    return prices[count - 1];
+}
+
+template<Side S>
+inline bool CompactLevels<S>::find(uint32_t price, LevelHandle& handle) const {
+    size_t idx = near_touch_idx<S>(prices, count, price);
+    if (idx == count || prices[idx] != price) {
+        return false;
+    }
+
+    handle = price;
+    return true;
+}
+
+}
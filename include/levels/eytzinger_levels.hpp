@@ -0,0 +1,406 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+#include "order_book_shared.hpp"
+#include "levels/near_touch_search.hpp"
+
+namespace OB {
+
+// Level store for symbols with thousands of live levels. The prices of the
+// levels are laid out as an Eytzinger tree (node k has its children at 2k and
+// 2k + 1), so the search walks down the tree without branching on the
+// comparison and the nodes four levels ahead are prefetched, they share one
+// cache line. rank[k] is the position of node k in the sorted order, where
+// the best price is the last one like in the other sorted stores.
+//
+// The tree is only rebuilt in batches. New prices wait in a small sorted
+// pending buffer which is searched next to the tree, and an emptied level
+// leaves a tombstone in the tree which is revived if the price comes back.
+// The tree is rebuilt with the pending levels merged in when the buffer is
+// full, when the tombstones pile up, or by compact() when ingest is idle.
+template<Side S>
+class EytzingerLevels {
+public:
+    EytzingerLevels() {
+        slots.reserve(5000);
+        tree.resize(1);
+        rank.resize(1);
+    }
+
+    BestLvlChange add(Level level, LevelHandle& handle);
+    BestLvlChange remove(LevelHandle handle, uint64_t qty);
+
+    Level best() const;
+    LevelHandle best_handle() const;
+    bool find(uint32_t price, LevelHandle& handle) const;
+
+    void compact();
+
+    void order_left(LevelHandle handle) {
+        slots[handle].orders--;
+    }
+
+    size_t copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const;
+
+    size_t size() const {
+        return sorted_prices.size() - dead + pending_prices.size();
+    }
+
+    // visits every level, the tree first and the pending buffer after it
+    template<typename F>
+    void for_each(F&& f) const {
+        for (LevelHandle handle : sorted_handles) {
+            if (handle != tombstone) {
+                f(slots[handle]);
+            }
+        }
+
+        for (LevelHandle handle : pending_handles) {
+            f(slots[handle]);
+        }
+    }
+
+private:
+    static constexpr LevelHandle tombstone = UINT32_MAX;
+    static constexpr uint32_t in_pending = UINT32_MAX;
+    static constexpr size_t npos = SIZE_MAX;
+    static constexpr size_t min_pending = 64;
+    static constexpr size_t max_pending = 1024;
+
+    bool better(uint32_t lhs, uint32_t rhs) const;
+    size_t tree_find(uint32_t price) const;
+    size_t build(size_t i, size_t k);
+    void rebuild();
+    LevelHandle acquire_slot(Level level);
+    void walk_top();
+
+    LevelHandle best_level() const;
+    BestLvlChange best_change() const;
+
+    // 1-indexed, tree[0] and rank[0] are unused
+    std::vector<uint32_t> tree;
+    std::vector<uint32_t> rank;
+
+    // the tree levels in sorted order, top is the best live one
+    std::vector<uint32_t> sorted_prices;
+    std::vector<LevelHandle> sorted_handles;
+    size_t top = npos;
+    size_t dead = 0;
+
+    // best at the back, like VectorLevelBSearchSplit
+    std::vector<uint32_t> pending_prices;
+    std::vector<LevelHandle> pending_handles;
+    size_t pending_limit = min_pending;
+
+    std::vector<Level> slots;
+    std::vector<uint32_t> slot_rank;
+    std::vector<LevelHandle> free_slots;
+};
+
+template<Side S>
+inline bool EytzingerLevels<S>::better(uint32_t lhs, uint32_t rhs) const {
+    if constexpr (S == Side::Bid) {
+        return lhs > rhs;
+    } else {
+        return lhs < rhs;
+    }
+}
+
+// sorted position of the price in the tree, or npos when it isn't there
+template<Side S>
+inline size_t EytzingerLevels<S>::tree_find(uint32_t price) const {
+    const size_t n = sorted_prices.size();
+    const uint32_t* t = tree.data();
+
+    size_t k = 1;
+    while (k <= n) {
+        __builtin_prefetch(t + 16 * k);
+        k = 2 * k + price_before<S>(t[k], price);
+    }
+
+    // drop the right turns taken after the last left one, that node is the
+    // first price which isn't before the searched one
+    k >>= std::countr_one(k) + 1;
+    if (k == 0 || t[k] != price) {
+        return npos;
+    }
+
+    return rank[k];
+}
+
+template<Side S>
+inline LevelHandle EytzingerLevels<S>::acquire_slot(Level level) {
+    if (!free_slots.empty()) {
+        LevelHandle handle = free_slots.back();
+        free_slots.pop_back();
+        slots[handle] = level;
+        return handle;
+    }
+
+    slots.push_back(level);
+    slot_rank.push_back(in_pending);
+    return slots.size() - 1;
+}
+
+template<Side S>
+inline LevelHandle EytzingerLevels<S>::best_level() const {
+    bool has_tree = top != npos;
+    bool has_pending = !pending_prices.empty();
+
+    if (has_tree && (!has_pending || better(sorted_prices[top], pending_prices.back()))) {
+        return sorted_handles[top];
+    }
+
+    return has_pending ? pending_handles.back() : tombstone;
+}
+
+template<Side S>
+inline BestLvlChange EytzingerLevels<S>::best_change() const {
+    LevelHandle handle = best_level();
+    if (handle == tombstone) {
+        return BestLvlChange{
+            .qty = 0,
+            .price = 0,
+            .side = S
+        };
+    }
+
+    const Level& best = slots[handle];
+    return BestLvlChange{
+        .qty = best.qty,
+        .price = best.price,
+        .side = S
+    };
+}
+
+// only ever moves towards the front between two rebuilds, new prices above the
+// top go to the pending buffer
+template<Side S>
+inline void EytzingerLevels<S>::walk_top() {
+    while (top != npos && sorted_handles[top] == tombstone) {
+        top = top == 0 ? npos : top - 1;
+    }
+}
+
+template<Side S>
+inline BestLvlChange EytzingerLevels<S>::add(Level level, LevelHandle& handle) {
+    LevelHandle old_best = best_level();
+    bool best_changed = old_best == tombstone || !better(slots[old_best].price, level.price);
+
+    size_t r = tree_find(level.price);
+    if (r != npos) {
+        if (sorted_handles[r] == tombstone) {
+            handle = acquire_slot(level);
+            sorted_handles[r] = handle;
+            slot_rank[handle] = r;
+            dead--;
+            if (top == npos || r > top) {
+                top = r;
+            }
+        } else {
+            handle = sorted_handles[r];
+            slots[handle].qty += level.qty;
+            slots[handle].orders += level.orders;
+        }
+    } else {
+        size_t idx = near_touch_idx<S>(pending_prices.data(), pending_prices.size(), level.price);
+        if (idx != pending_prices.size() && pending_prices[idx] == level.price) {
+            handle = pending_handles[idx];
+            slots[handle].qty += level.qty;
+            slots[handle].orders += level.orders;
+        } else {
+            handle = acquire_slot(level);
+            slot_rank[handle] = in_pending;
+            pending_prices.insert(pending_prices.begin() + idx, level.price);
+            pending_handles.insert(pending_handles.begin() + idx, handle);
+
+            if (pending_prices.size() >= pending_limit) [[unlikely]] {
+                rebuild();
+            }
+        }
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    return best_change();
+}
+
+template<Side S>
+inline BestLvlChange EytzingerLevels<S>::remove(LevelHandle handle, uint64_t qty) {
+    Level& level = slots[handle];
+    UNEXPECTED(qty > level.qty, "Remove underflow");
+
+    bool best_changed = handle == best_level();
+
+    level.qty -= qty;
+    if (level.qty == 0) [[unlikely]] {
+        uint32_t r = slot_rank[handle];
+        if (r != in_pending) {
+            sorted_handles[r] = tombstone;
+            dead++;
+            if (r == top) {
+                walk_top();
+            }
+        } else {
+            size_t idx = near_touch_idx<S>(pending_prices.data(), pending_prices.size(), level.price);
+            UNEXPECTED(idx == pending_prices.size() || pending_handles[idx] != handle, "Remove didn't find a level");
+            pending_prices.erase(pending_prices.begin() + idx);
+            pending_handles.erase(pending_handles.begin() + idx);
+        }
+        free_slots.push_back(handle);
+
+        if (dead > sorted_prices.size() / 2 + min_pending) [[unlikely]] {
+            rebuild();
+        }
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    return best_change();
+}
+
+// in order walk which fills node k and its subtree from sorted position i on
+template<Side S>
+size_t EytzingerLevels<S>::build(size_t i, size_t k) {
+    if (k <= sorted_prices.size()) {
+        i = build(i, 2 * k);
+        tree[k] = sorted_prices[i];
+        rank[k] = uint32_t(i);
+        i++;
+        i = build(i, 2 * k + 1);
+    }
+
+    return i;
+}
+
+template<Side S>
+void EytzingerLevels<S>::rebuild() {
+    std::vector<uint32_t> prices;
+    std::vector<LevelHandle> handles;
+    prices.reserve(sorted_prices.size() - dead + pending_prices.size());
+    handles.reserve(prices.capacity());
+
+    // merge the live tree levels with the pending ones
+    size_t p = 0;
+    for (size_t i = 0; i < sorted_prices.size(); ++i) {
+        if (sorted_handles[i] == tombstone) {
+            continue;
+        }
+
+        while (p < pending_prices.size() && price_before<S>(pending_prices[p], sorted_prices[i])) {
+            prices.push_back(pending_prices[p]);
+            handles.push_back(pending_handles[p]);
+            p++;
+        }
+
+        prices.push_back(sorted_prices[i]);
+        handles.push_back(sorted_handles[i]);
+    }
+
+    prices.insert(prices.end(), pending_prices.begin() + p, pending_prices.end());
+    handles.insert(handles.end(), pending_handles.begin() + p, pending_handles.end());
+
+    sorted_prices.swap(prices);
+    sorted_handles.swap(handles);
+    pending_prices.clear();
+    pending_handles.clear();
+    dead = 0;
+
+    const size_t n = sorted_prices.size();
+    tree.assign(n + 1, 0);
+    rank.assign(n + 1, 0);
+    build(0, 1);
+
+    for (size_t i = 0; i < n; ++i) {
+        slot_rank[sorted_handles[i]] = uint32_t(i);
+    }
+
+    top = n == 0 ? npos : n - 1;
+    pending_limit = std::clamp(n / 16, min_pending, max_pending);
+}
+
+template<Side S>
+void EytzingerLevels<S>::compact() {
+    if (!pending_prices.empty() || dead != 0) {
+        rebuild();
+    }
+}
+
+template<Side S>
+inline Level EytzingerLevels<S>::best() const {
+    LevelHandle handle = best_level();
+    if (handle == tombstone) {
+        return {0, 0};
+    }
+
+    return slots[handle];
+}
+
+template<Side S>
+inline LevelHandle EytzingerLevels<S>::best_handle() const {
+    LevelHandle handle = best_level();
+    UNEXPECTED(handle == tombstone, "Best handle on an empty side");
+    return handle;
+}
+
+template<Side S>
+inline bool EytzingerLevels<S>::find(uint32_t price, LevelHandle& handle) const {
+    size_t r = tree_find(price);
+    if (r != npos) {
+        if (sorted_handles[r] == tombstone) {
+            return false;
+        }
+        handle = sorted_handles[r];
+        return true;
+    }
+
+    size_t idx = near_touch_idx<S>(pending_prices.data(), pending_prices.size(), price);
+    if (idx == pending_prices.size() || pending_prices[idx] != price) {
+        return false;
+    }
+
+    handle = pending_handles[idx];
+    return true;
+}
+
+
+// merges the tree levels below the top with the pending buffer, both are
+// sorted with the best price last
+template<Side S>
+inline size_t EytzingerLevels<S>::copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const {
+    size_t t = top == npos ? 0 : top + 1;
+    size_t p = pending_prices.size();
+
+    size_t count = 0;
+    while (count < n) {
+        while (t > 0 && sorted_handles[t - 1] == tombstone) {
+            t--;
+        }
+        if (t == 0 && p == 0) {
+            break;
+        }
+
+        LevelHandle handle;
+        if (p == 0 || (t > 0 && better(sorted_prices[t - 1], pending_prices[p - 1]))) {
+            handle = sorted_handles[--t];
+        } else {
+            handle = pending_handles[--p];
+        }
+
+        const Level& level = slots[handle];
+        out_qtys[count] = level.qty;
+        out_prices[count] = level.price;
+        out_orders[count] = level.orders;
+        count++;
+    }
+
+    return count;
+}
+
+}
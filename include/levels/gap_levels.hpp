@@ -0,0 +1,294 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "order_book_shared.hpp"
+#include "levels/near_touch_search.hpp"
+
+namespace OB {
+
+// Same SoA layout as VectorLevelBSearchSplit: sorted prices with the best one
+// at the back and the handles of the level slots next to them. An emptied
+// level is not erased, its entry becomes a tombstone which keeps its price so
+// the array stays sorted for the search. Creating a level moves the elements
+// up to the closest tombstone instead of everything up to the back, and a
+// level which comes back at the price of a tombstone is revived in place.
+//
+// compact() drops the tombstones and leaves a gap after every gap_every
+// levels away from the touch, where the deep levels churn without ever being
+// close to the back. It runs when ingest is idle, or right away when the
+// tombstones outnumber the levels.
+template<Side S>
+class GapLevels {
+public:
+    GapLevels() {
+        prices.reserve(5000);
+        handles.reserve(5000);
+        slots.reserve(5000);
+    }
+
+    BestLvlChange remove(LevelHandle handle, uint64_t qty);
+    BestLvlChange add(Level level, LevelHandle& handle);
+
+    Level best() const;
+    LevelHandle best_handle() const;
+    bool find(uint32_t price, LevelHandle& handle) const;
+
+    void compact();
+
+    size_t tombstones() const {
+        return dead;
+    }
+
+    void order_left(LevelHandle handle) {
+        slots[handle].orders--;
+    }
+
+    size_t copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const;
+
+    std::vector<uint32_t> prices;
+    std::vector<LevelHandle> handles;
+
+private:
+    static constexpr LevelHandle tombstone = UINT32_MAX;
+    static constexpr size_t max_shift = 32;
+    static constexpr size_t gap_every = 8;
+    static constexpr size_t near_touch = 64;
+
+    size_t find_idx(uint32_t price) const;
+    LevelHandle acquire_slot(Level level);
+    void insert_at(size_t idx, uint32_t price, LevelHandle handle);
+    void pop_tombstones();
+    BestLvlChange best_change() const;
+
+    std::vector<Level> slots;
+    std::vector<LevelHandle> free_slots;
+    size_t dead = 0;
+};
+
+template<Side S>
+inline Level GapLevels<S>::best() const {
+    if (!prices.empty()) {
+        return slots[handles.back()];
+    } else {
+        return {0, 0};
+    }
+}
+
+template<Side S>
+inline LevelHandle GapLevels<S>::best_handle() const {
+    UNEXPECTED(prices.empty(), "Best handle on an empty side");
+    return handles.back();
+}
+
+// among the entries of a price the first one is the live one if there is any,
+// so the search lands on it
+template<Side S>
+inline size_t GapLevels<S>::find_idx(uint32_t price) const {
+    return near_touch_idx<S>(prices.data(), prices.size(), price);
+}
+
+template<Side S>
+inline bool GapLevels<S>::find(uint32_t price, LevelHandle& handle) const {
+    size_t idx = find_idx(price);
+    if (idx == prices.size() || prices[idx] != price || handles[idx] == tombstone) {
+        return false;
+    }
+
+    handle = handles[idx];
+    return true;
+}
+
+template<Side S>
+inline LevelHandle GapLevels<S>::acquire_slot(Level level) {
+    if (!free_slots.empty()) {
+        LevelHandle handle = free_slots.back();
+        free_slots.pop_back();
+        slots[handle] = level;
+        return handle;
+    }
+
+    slots.push_back(level);
+    return slots.size() - 1;
+}
+
+template<Side S>
+inline BestLvlChange GapLevels<S>::best_change() const {
+    if (prices.empty()) {
+        return BestLvlChange{
+            .qty = 0,
+            .price = 0,
+            .side = S
+        };
+    }
+
+    const Level& best = slots[handles.back()];
+    return BestLvlChange{
+        .qty = best.qty,
+        .price = best.price,
+        .side = S
+    };
+}
+
+// the back always holds the best live level
+template<Side S>
+inline void GapLevels<S>::pop_tombstones() {
+    while (!handles.empty() && handles.back() == tombstone) {
+        prices.pop_back();
+        handles.pop_back();
+        dead--;
+    }
+}
+
+// the new price goes between idx - 1 and idx
+template<Side S>
+inline void GapLevels<S>::insert_at(size_t idx, uint32_t price, LevelHandle handle) {
+    const size_t size = prices.size();
+    size_t up = idx;
+    size_t down = idx;
+
+    for (size_t step = 0; step < max_shift; ++step) {
+        if (up < size && handles[up] == tombstone) {
+            // shift [idx, up) one towards the back into the tombstone
+            std::copy_backward(prices.begin() + idx, prices.begin() + up, prices.begin() + up + 1);
+            std::copy_backward(handles.begin() + idx, handles.begin() + up, handles.begin() + up + 1);
+            prices[idx] = price;
+            handles[idx] = handle;
+            dead--;
+            return;
+        }
+
+        if (down > 0 && handles[down - 1] == tombstone) {
+            // shift [down, idx) one towards the front into the tombstone
+            std::copy(prices.begin() + down, prices.begin() + idx, prices.begin() + down - 1);
+            std::copy(handles.begin() + down, handles.begin() + idx, handles.begin() + down - 1);
+            prices[idx - 1] = price;
+            handles[idx - 1] = handle;
+            dead--;
+            return;
+        }
+
+        up++;
+        if (down > 0) {
+            down--;
+        }
+    }
+
+    prices.insert(prices.begin() + idx, price);
+    handles.insert(handles.begin() + idx, handle);
+}
+
+template<Side S>
+inline BestLvlChange GapLevels<S>::add(Level level, LevelHandle& handle) {
+    const size_t old_size = prices.size();
+    size_t idx = find_idx(level.price);
+    bool best_changed = old_size == 0 || idx + 1 >= old_size;
+
+    if (idx != old_size && prices[idx] == level.price) {
+        if (handles[idx] == tombstone) {
+            handles[idx] = acquire_slot(level);
+            dead--;
+        } else {
+            slots[handles[idx]].qty += level.qty;
+            slots[handles[idx]].orders += level.orders;
+        }
+        handle = handles[idx];
+    } else {
+        handle = acquire_slot(level);
+        insert_at(idx, level.price, handle);
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    return best_change();
+}
+
+template<Side S>
+inline BestLvlChange GapLevels<S>::remove(LevelHandle handle, uint64_t qty) {
+    Level& level = slots[handle];
+    UNEXPECTED(prices.empty(), "Remove on an empty side");
+    UNEXPECTED(qty > level.qty, "Remove underflow");
+
+    bool best_changed = handle == handles.back();
+
+    level.qty -= qty;
+    if (level.qty == 0) [[unlikely]] {
+        size_t idx = find_idx(level.price);
+        UNEXPECTED(idx == prices.size() || handles[idx] != handle, "Remove didn't find a level");
+
+        handles[idx] = tombstone;
+        free_slots.push_back(handle);
+        dead++;
+
+        if (best_changed) {
+            pop_tombstones();
+        } else if (dead > prices.size() - dead + 256) [[unlikely]] {
+            compact();
+        }
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    return best_change();
+}
+
+template<Side S>
+void GapLevels<S>::compact() {
+    const size_t live = prices.size() - dead;
+    if (dead <= live / 4) {
+        return; // about the gaps the last compaction left
+    }
+    const size_t deep = live > near_touch ? live - near_touch : 0;
+
+    std::vector<uint32_t> new_prices;
+    std::vector<LevelHandle> new_handles;
+    new_prices.reserve(std::max(prices.capacity(), live + deep / gap_every));
+    new_handles.reserve(new_prices.capacity());
+
+    size_t seen = 0;
+    for (size_t i = 0; i < prices.size(); ++i) {
+        if (handles[i] == tombstone) {
+            continue;
+        }
+
+        new_prices.push_back(prices[i]);
+        new_handles.push_back(handles[i]);
+        seen++;
+
+        // a gap repeats the price of the level before it, the search still
+        // lands on the live one
+        if (seen < deep && seen % gap_every == 0) {
+            new_prices.push_back(prices[i]);
+            new_handles.push_back(tombstone);
+        }
+    }
+
+    prices.swap(new_prices);
+    handles.swap(new_handles);
+    dead = prices.size() - live;
+}
+
+
+// walks down from the back, stepping over the tombstones
+template<Side S>
+inline size_t GapLevels<S>::copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const {
+    size_t count = 0;
+    for (size_t i = handles.size(); i-- > 0 && count < n;) {
+        if (handles[i] == tombstone) {
+            continue;
+        }
+
+        const Level& level = slots[handles[i]];
+        out_qtys[count] = level.qty;
+        out_prices[count] = level.price;
+        out_orders[count] = level.orders;
+        count++;
+    }
+
+    return count;
+}
+
+}
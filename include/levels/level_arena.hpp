@@ -0,0 +1,114 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+// Bump allocator for the level arrays of the compact books. Memory is taken
+// from the system in 2MB chunks and carved into power of two blocks, a block
+// given back goes to the free list of its size and is handed out again to
+// the next book which grows into that size. Nothing is returned to the system
+// before the end of the session, the books of a day only ever grow to the
+// depth the day needs.
+class LevelArena {
+public:
+    static constexpr size_t chunk_bytes = 2 * 1024 * 1024;
+    static constexpr size_t min_block = 64;
+
+    LevelArena() = default;
+    LevelArena(const LevelArena&) = delete;
+    LevelArena& operator=(const LevelArena&) = delete;
+
+    ~LevelArena() {
+        for (void* chunk : chunks) {
+            std::free(chunk);
+        }
+    }
+
+    // size of the block allocate() hands out for that many bytes
+    static size_t block_size(size_t bytes) {
+        return std::bit_ceil(std::max(bytes, min_block));
+    }
+
+    void* allocate(size_t bytes);
+    void release(void* block, size_t bytes);
+
+    size_t reserved_bytes() const {
+        return reserved;
+    }
+
+    size_t used_bytes() const {
+        return used;
+    }
+
+private:
+    static size_t size_class(size_t block) {
+        return std::countr_zero(block);
+    }
+
+    void* allocate_chunk(size_t bytes);
+
+    std::array<std::vector<void*>, 64> free_lists;
+    std::vector<void*> chunks;
+    std::byte* cursor = nullptr;
+    size_t left = 0;
+
+    size_t reserved = 0;
+    size_t used = 0;
+};
+
+inline void* LevelArena::allocate_chunk(size_t bytes) {
+    void* chunk = std::aligned_alloc(64, bytes);
+    UNEXPECTED(chunk == nullptr, "LevelArena allocation failed");
+    chunks.push_back(chunk);
+    reserved += bytes;
+    return chunk;
+}
+
+inline void* LevelArena::allocate(size_t bytes) {
+    size_t block = block_size(bytes);
+    used += block;
+
+    auto& free_list = free_lists[size_class(block)];
+    if (!free_list.empty()) {
+        void* ptr = free_list.back();
+        free_list.pop_back();
+        return ptr;
+    }
+
+    // the deep books get their own chunk
+    if (block > chunk_bytes / 4) [[unlikely]] {
+        return allocate_chunk(block);
+    }
+
+    if (left < block) {
+        // the tail of the old chunk is lost, at most a quarter of a chunk
+        cursor = static_cast<std::byte*>(allocate_chunk(chunk_bytes));
+        left = chunk_bytes;
+    }
+
+    void* ptr = cursor;
+    cursor += block;
+    left -= block;
+    return ptr;
+}
+
+inline void LevelArena::release(void* block, size_t bytes) {
+    size_t size = block_size(bytes);
+    used -= size;
+    free_lists[size_class(size)].push_back(block);
+}
+
+// one arena for all the books of the session, ingest runs on a single thread
+inline LevelArena& session_level_arena() {
+    static LevelArena arena;
+    return arena;
+}
+
+}
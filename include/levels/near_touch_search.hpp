@@ -0,0 +1,92 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+// Search for the position of a price in a side sorted with the best price at
+// the back (ascending for bids, descending for asks). Returns the same index
+// as std::lower_bound with the side ordering.
+//
+// Most adds and level removals land within a few levels of the touch, so the
+// back of the array is scanned first, a vector of prices at a time, and the
+// binary search only runs over the part which is left when the price turns out
+// to be deeper than near_touch_chunks vectors. The kernel is picked at compile
+// time from the target ISA: 16 lanes with AVX-512, 8 with AVX2, otherwise a
+// short scalar scan.
+
+#if defined(__AVX512F__)
+inline constexpr size_t near_touch_lanes = 16;
+#elif defined(__AVX2__)
+inline constexpr size_t near_touch_lanes = 8;
+#else
+inline constexpr size_t near_touch_lanes = 1;
+#endif
+
+inline constexpr size_t near_touch_chunks = near_touch_lanes == 1 ? 8 : 4;
+
+template<Side S>
+inline bool price_before(uint32_t lhs, uint32_t price) {
+    if constexpr (S == Side::Bid) {
+        return lhs < price;
+    } else {
+        return lhs > price;
+    }
+}
+
+template<Side S>
+inline size_t binary_search_idx(const uint32_t* prices, size_t n, uint32_t price) {
+    return std::lower_bound(prices, prices + n, price, price_before<S>) - prices;
+}
+
+// number of the lanes in [prices, prices + near_touch_lanes) which are not
+// before the price, they are always a suffix of the chunk
+template<Side S>
+inline uint32_t count_not_before(const uint32_t* prices, uint32_t price) {
+#if defined(__AVX512F__)
+    __m512i v = _mm512_loadu_si512(prices);
+    __m512i p = _mm512_set1_epi32(int(price));
+    __mmask16 mask;
+    if constexpr (S == Side::Bid) {
+        mask = _mm512_cmp_epu32_mask(v, p, _MM_CMPINT_NLT);
+    } else {
+        mask = _mm512_cmp_epu32_mask(v, p, _MM_CMPINT_LE);
+    }
+    return std::popcount(uint32_t(mask));
+#elif defined(__AVX2__)
+    // no unsigned compare in AVX2, v >= p is max(v, p) == v
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices));
+    __m256i p = _mm256_set1_epi32(int(price));
+    __m256i bound;
+    if constexpr (S == Side::Bid) {
+        bound = _mm256_max_epu32(v, p);
+    } else {
+        bound = _mm256_min_epu32(v, p);
+    }
+    __m256i eq = _mm256_cmpeq_epi32(bound, v);
+    return std::popcount(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(eq))));
+#else
+    return price_before<S>(*prices, price) ? 0 : 1;
+#endif
+}
+
+template<Side S>
+inline size_t near_touch_idx(const uint32_t* prices, size_t n, uint32_t price) {
+    size_t end = n;
+    for (size_t chunk = 0; chunk < near_touch_chunks && end >= near_touch_lanes; ++chunk) {
+        size_t start = end - near_touch_lanes;
+        uint32_t not_before = count_not_before<S>(prices + start, price);
+        if (not_before != near_touch_lanes) {
+            return end - not_before;
+        }
+        end = start;
+    }
+
+    return binary_search_idx<S>(prices, end, price);
+}
+
+}
@@ -0,0 +1,182 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <sys/mman.h>
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+// Hierarchical occupancy bitmap over Bits indices. Level 0 has one bit per
+// index, every bit of level k + 1 tells whether the matching 64 bit word of
+// level k is non zero, up to a single top word. Finding the closest set bit
+// below or above an index is one lzcnt/tzcnt per level, no matter how far
+// away the bit is.
+//
+// The words are mapped with MAP_NORESERVE, so only the parts of the bitmap
+// which are actually touched get committed. This keeps even a bitmap over
+// the whole uint32 range cheap for a sparse set of indices.
+
+template<uint64_t Bits>
+class OccupancyBitmap {
+public:
+    static constexpr uint64_t npos = UINT64_MAX;
+
+    OccupancyBitmap() {
+        void* mem = mmap(nullptr, total_words * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        UNEXPECTED(mem == MAP_FAILED, "OccupancyBitmap mmap failed");
+        words = static_cast<uint64_t*>(mem);
+    }
+
+    ~OccupancyBitmap() {
+        munmap(words, total_words * sizeof(uint64_t));
+    }
+
+    OccupancyBitmap(const OccupancyBitmap&) = delete;
+    OccupancyBitmap& operator=(const OccupancyBitmap&) = delete;
+
+    void set(uint64_t i);
+    void clear(uint64_t i);
+    bool test(uint64_t i) const;
+
+    // closest set index <= i, or npos
+    uint64_t prev(uint64_t i) const;
+    // closest set index >= i, or npos
+    uint64_t next(uint64_t i) const;
+
+    // the level 0 words, for callers who want to look at the raw occupancy
+    const uint64_t* level0() const {
+        return words;
+    }
+
+private:
+    static constexpr size_t count_levels() {
+        size_t levels = 1;
+        for (uint64_t n = (Bits + 63) / 64; n > 1; n = (n + 63) / 64) {
+            levels++;
+        }
+        return levels;
+    }
+
+    static constexpr size_t levels = count_levels();
+
+    struct Layout {
+        std::array<uint64_t, levels> offset;
+        std::array<uint64_t, levels> size;
+        uint64_t total;
+    };
+
+    static constexpr Layout make_layout() {
+        Layout layout{};
+        uint64_t n = (Bits + 63) / 64;
+        for (size_t l = 0; l < levels; ++l) {
+            layout.offset[l] = layout.total;
+            layout.size[l] = n;
+            layout.total += n;
+            n = (n + 63) / 64;
+        }
+        return layout;
+    }
+
+    static constexpr Layout layout = make_layout();
+    static constexpr uint64_t total_words = layout.total;
+
+    uint64_t* level_words(size_t level) const {
+        return words + layout.offset[level];
+    }
+
+    uint64_t* words;
+};
+
+template<uint64_t Bits>
+inline bool OccupancyBitmap<Bits>::test(uint64_t i) const {
+    return (words[i >> 6] >> (i & 63)) & 1;
+}
+
+template<uint64_t Bits>
+inline void OccupancyBitmap<Bits>::set(uint64_t i) {
+    for (size_t l = 0; l < levels; ++l) {
+        uint64_t& word = level_words(l)[i >> 6];
+        bool was_empty = word == 0;
+        word |= 1ull << (i & 63);
+        if (!was_empty) {
+            return;
+        }
+        i >>= 6;
+    }
+}
+
+template<uint64_t Bits>
+inline void OccupancyBitmap<Bits>::clear(uint64_t i) {
+    for (size_t l = 0; l < levels; ++l) {
+        uint64_t& word = level_words(l)[i >> 6];
+        word &= ~(1ull << (i & 63));
+        if (word != 0) {
+            return;
+        }
+        i >>= 6;
+    }
+}
+
+template<uint64_t Bits>
+inline uint64_t OccupancyBitmap<Bits>::prev(uint64_t i) const {
+    size_t l = 0;
+
+    // climb until a word has a set bit at or below the position
+    while (true) {
+        uint64_t w = i >> 6;
+        uint64_t bits = level_words(l)[w] & (~0ull >> (63 - (i & 63)));
+        if (bits != 0) {
+            i = (w << 6) | (63 - std::countl_zero(bits));
+            break;
+        }
+
+        if (w == 0 || l + 1 == levels) {
+            return npos;
+        }
+
+        i = w - 1;
+        l++;
+    }
+
+    // then take the highest bit on the way down
+    while (l > 0) {
+        l--;
+        uint64_t bits = level_words(l)[i];
+        i = (i << 6) | (63 - std::countl_zero(bits));
+    }
+
+    return i;
+}
+
+template<uint64_t Bits>
+inline uint64_t OccupancyBitmap<Bits>::next(uint64_t i) const {
+    size_t l = 0;
+
+    while (true) {
+        uint64_t w = i >> 6;
+        uint64_t bits = level_words(l)[w] & (~0ull << (i & 63));
+        if (bits != 0) {
+            i = (w << 6) | std::countr_zero(bits);
+            break;
+        }
+
+        if (w + 1 >= layout.size[l] || l + 1 == levels) {
+            return npos;
+        }
+
+        i = w + 1;
+        l++;
+    }
+
+    while (l > 0) {
+        l--;
+        uint64_t bits = level_words(l)[i];
+        i = (i << 6) | std::countr_zero(bits);
+    }
+
+    return i;
+}
+
+}
@@ -0,0 +1,236 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <sys/mman.h>
+#include "order_book_shared.hpp"
+#include "levels/occupancy_bitmap.hpp"
+
+namespace OB {
+
+// Dense qty ladder over the whole uint32 price range. The 32GB of qtys are
+// only a MAP_NORESERVE reservation, a page gets committed when the first level
+// in it is touched and handed back to the kernel with MADV_DONTNEED once all
+// its levels are empty again, so the footprint follows the prices which are
+// actually quoted. Best level recovery goes through the same hierarchical
+// bitmap as BitmapLevels and the handle of a level is its price.
+//
+// Pages are not released right away when they empty, because the pages next
+// to the touch empty and refill all the time. They are remembered and given
+// back by release_empty_pages(), which the owner calls when ingest is idle.
+// A page is a candidate at most once between two releases, the pending bitmap
+// keeps the candidate list as short as the number of distinct pages.
+
+template<Side S, size_t PageBytes>
+class PagedLadderLevelsT {
+public:
+    PagedLadderLevelsT() {
+        void* mem = mmap(nullptr, N * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        UNEXPECTED(mem == MAP_FAILED, "PagedLadderLevels mmap failed");
+        qtys = static_cast<uint64_t*>(mem);
+
+        if constexpr (PageBytes > 4096) {
+            madvise(qtys, N * sizeof(uint64_t), MADV_HUGEPAGE);
+        }
+    }
+
+    ~PagedLadderLevelsT() {
+        munmap(qtys, N * sizeof(uint64_t));
+    }
+
+    PagedLadderLevelsT(const PagedLadderLevelsT&) = delete;
+    PagedLadderLevelsT& operator=(const PagedLadderLevelsT&) = delete;
+
+    BestLvlChange add(Level level, LevelHandle& handle);
+    BestLvlChange remove(LevelHandle handle, uint64_t qty);
+
+    Level best() const;
+    LevelHandle best_handle() const;
+    bool find(uint32_t price, LevelHandle& handle) const;
+
+    void release_empty_pages();
+
+    size_t copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const;
+
+    size_t committed_bytes() const {
+        return committed_pages * PageBytes;
+    }
+
+private:
+    static constexpr uint64_t N = 1ull << 32;
+    static constexpr uint64_t prices_per_page = PageBytes / sizeof(uint64_t);
+    static constexpr uint64_t npos = UINT64_MAX;
+
+    static_assert(PageBytes % 4096 == 0);
+
+    bool page_empty(uint64_t page) const;
+    BestLvlChange best_change() const;
+
+    uint64_t* qtys;
+    OccupancyBitmap<N> occupied;
+    OccupancyBitmap<N / prices_per_page> resident;
+    OccupancyBitmap<N / prices_per_page> pending;
+    size_t committed_pages = 0;
+    std::vector<uint64_t> release_candidates;
+
+    uint64_t best_idx = npos;
+};
+
+template<Side S>
+using PagedLadderLevels = PagedLadderLevelsT<S, 4096>;
+
+template<Side S>
+using HugePagedLadderLevels = PagedLadderLevelsT<S, 2 * 1024 * 1024>;
+
+template<Side S, size_t PageBytes>
+inline bool PagedLadderLevelsT<S, PageBytes>::page_empty(uint64_t page) const {
+    uint64_t first = page * prices_per_page;
+    uint64_t next = occupied.next(first);
+    return next == npos || next >= first + prices_per_page;
+}
+
+template<Side S, size_t PageBytes>
+inline BestLvlChange PagedLadderLevelsT<S, PageBytes>::best_change() const {
+    if (best_idx == npos) {
+        return BestLvlChange{
+            .qty = 0,
+            .price = 0,
+            .side = S
+        };
+    }
+
+    return BestLvlChange{
+        .qty = qtys[best_idx],
+        .price = uint32_t(best_idx),
+        .side = S
+    };
+}
+
+template<Side S, size_t PageBytes>
+inline BestLvlChange PagedLadderLevelsT<S, PageBytes>::add(Level level, LevelHandle& handle) {
+    handle = level.price;
+    uint64_t& qty = qtys[level.price];
+
+    if (qty == 0) {
+        uint64_t page = level.price / prices_per_page;
+        if (!resident.test(page)) [[unlikely]] {
+            resident.set(page);
+            committed_pages++;
+        }
+        occupied.set(level.price);
+    }
+    qty += level.qty;
+
+    bool best_changed;
+    if constexpr (S == Side::Bid) {
+        best_changed = best_idx == npos || level.price >= best_idx;
+    } else {
+        best_changed = level.price <= best_idx;
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    best_idx = level.price;
+    return best_change();
+}
+
+template<Side S, size_t PageBytes>
+inline BestLvlChange PagedLadderLevelsT<S, PageBytes>::remove(LevelHandle handle, uint64_t qty) {
+    uint64_t& level_qty = qtys[handle];
+    UNEXPECTED(qty > level_qty, "Remove underflow");
+
+    bool best_changed = handle == best_idx;
+
+    level_qty -= qty;
+    if (level_qty == 0) {
+        occupied.clear(handle);
+
+        uint64_t page = handle / prices_per_page;
+        if (page_empty(page) && !pending.test(page)) [[unlikely]] {
+            pending.set(page);
+            release_candidates.push_back(page);
+        }
+
+        if (best_changed) {
+            if constexpr (S == Side::Bid) {
+                best_idx = handle == 0 ? npos : occupied.prev(handle - 1);
+            } else {
+                best_idx = handle + 1 == N ? npos : occupied.next(handle + 1);
+            }
+        }
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    return best_change();
+}
+
+template<Side S, size_t PageBytes>
+void PagedLadderLevelsT<S, PageBytes>::release_empty_pages() {
+    for (uint64_t page : release_candidates) {
+        pending.clear(page);
+
+        // the page may have been refilled since it emptied
+        if (!resident.test(page) || !page_empty(page)) {
+            continue;
+        }
+
+        madvise(qtys + page * prices_per_page, PageBytes, MADV_DONTNEED);
+        resident.clear(page);
+        committed_pages--;
+    }
+
+    release_candidates.clear();
+}
+
+template<Side S, size_t PageBytes>
+inline Level PagedLadderLevelsT<S, PageBytes>::best() const {
+    if (best_idx == npos) {
+        return {0, 0};
+    }
+
+    return {qtys[best_idx], uint32_t(best_idx)};
+}
+
+template<Side S, size_t PageBytes>
+inline LevelHandle PagedLadderLevelsT<S, PageBytes>::best_handle() const {
+    UNEXPECTED(best_idx == npos, "Best handle on an empty side");
+    return uint32_t(best_idx);
+}
+
+template<Side S, size_t PageBytes>
+inline bool PagedLadderLevelsT<S, PageBytes>::find(uint32_t price, LevelHandle& handle) const {
+    if (qtys[price] == 0) {
+        return false;
+    }
+
+    handle = price;
+    return true;
+}
+
+
+template<Side S, size_t PageBytes>
+inline size_t PagedLadderLevelsT<S, PageBytes>::copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const {
+    size_t count = 0;
+    uint64_t idx = best_idx;
+    while (count < n && idx != npos) {
+        out_qtys[count] = qtys[idx];
+        out_prices[count] = uint32_t(idx);
+        out_orders[count] = 0;
+        count++;
+
+        if constexpr (S == Side::Bid) {
+            idx = idx == 0 ? npos : occupied.prev(idx - 1);
+        } else {
+            idx = idx + 1 == N ? npos : occupied.next(idx + 1);
+        }
+    }
+
+    return count;
+}
+
+}
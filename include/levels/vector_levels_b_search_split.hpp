@@ -2,60 +2,124 @@
 #include <vector>
 #include <algorithm>
 #include "order_book_shared.hpp"
+#include "depth_snapshot.hpp"
+#include "levels/near_touch_search.hpp"
 
 namespace OB {
 
+// prices are kept sorted with the best price at the back, next to them is the
+// handle of the slot holding the level. Slots never move, so the handle given
+// out by add() stays valid across insertions and erasures of other levels and
+// remove() goes straight to the level without searching for the price.
+// Since the touch is at the back, inserting or erasing a level near it only
+// shifts the few prices and handles above it.
 template<Side S>
 class VectorLevelBSearchSplit {
 public:
-    VectorLevelBSearchSplit() {
-        prices.reserve(5000);
-        qtys.reserve(5000);
+    explicit VectorLevelBSearchSplit(size_t capacity = 5000) {
+        prices.reserve(capacity);
+        handles.reserve(capacity);
+        slots.reserve(capacity);
     }
 
-    BestLvlChange remove(Level level);
-    BestLvlChange add(Level level);
+    BestLvlChange remove(LevelHandle handle, uint64_t qty);
+    BestLvlChange add(Level level, LevelHandle& handle);
 
     Level best() const;
+    LevelHandle best_handle() const;
+    bool find(uint32_t price, LevelHandle& handle) const;
+
+    size_t size() const {
+        return prices.size();
+    }
+
+    void order_left(LevelHandle handle) {
+        slots[handle].orders--;
+    }
+
+    size_t copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const;
+
+    // visits every level, from the worst price to the best one
+    template<typename F>
+    void for_each(F&& f) const {
+        for (LevelHandle handle : handles) {
+            f(slots[handle]);
+        }
+    }
 
     std::vector<uint32_t> prices;
-    std::vector<uint64_t> qtys;
+    std::vector<LevelHandle> handles;
+
+private:
+    size_t find_idx(uint32_t price) const;
+    LevelHandle acquire_slot(Level level);
+
+    std::vector<Level> slots;
+    std::vector<LevelHandle> free_slots;
 };
 
 template<Side S>
 inline Level VectorLevelBSearchSplit<S>::best() const {
     if (!prices.empty()) {
-        size_t i = prices.size() - 1;
-        return { qtys[i], prices[i] };
+        return slots[handles.back()];
     } else {
         return {0, 0};
     }
 }
 
 template<Side S>
-inline BestLvlChange VectorLevelBSearchSplit<S>::remove(Level level) {
-    const size_t old_size = prices.size();
-    auto it = std::lower_bound(
-        prices.begin(), prices.end(), level.price,
-        [](uint32_t lhs, uint32_t price) {
-            if constexpr (S == Side::Bid) {
-                return lhs < price;
-            } else {
-                return lhs > price;
-            }
-        }
-    );
+inline LevelHandle VectorLevelBSearchSplit<S>::best_handle() const {
+    UNEXPECTED(prices.empty(), "Best handle on an empty side");
+    return handles.back();
+}
+
+template<Side S>
+inline bool VectorLevelBSearchSplit<S>::find(uint32_t price, LevelHandle& handle) const {
+    size_t idx = find_idx(price);
+    if (idx == prices.size() || prices[idx] != price) {
+        return false;
+    }
+
+    handle = handles[idx];
+    return true;
+}
+
+// the touch is at the back, so this scans from there before falling back to
+// the binary search, see near_touch_search.hpp
+template<Side S>
+inline size_t VectorLevelBSearchSplit<S>::find_idx(uint32_t price) const {
+    return near_touch_idx<S>(prices.data(), prices.size(), price);
+}
+
+template<Side S>
+inline LevelHandle VectorLevelBSearchSplit<S>::acquire_slot(Level level) {
+    if (!free_slots.empty()) {
+        LevelHandle handle = free_slots.back();
+        free_slots.pop_back();
+        slots[handle] = level;
+        return handle;
+    }
 
-    UNEXPECTED(it == prices.end() || *it != level.price, "Remove didn't find a level");
-    size_t idx = it - prices.begin();
-    bool best_changed = idx + 1 == old_size;
+    slots.push_back(level);
+    return slots.size() - 1;
+}
+
+template<Side S>
+inline BestLvlChange VectorLevelBSearchSplit<S>::remove(LevelHandle handle, uint64_t qty) {
+    Level& level = slots[handle];
+    UNEXPECTED(prices.empty(), "Remove on an empty side");
+    UNEXPECTED(qty > level.qty, "Remove underflow");
 
-    UNEXPECTED(level.qty > qtys[idx], "Remove underflow");
+    bool best_changed = level.price == prices.back();
+
+    level.qty -= qty;
+    if (level.qty == 0) [[unlikely]] {
+        size_t idx = find_idx(level.price);
+        UNEXPECTED(idx == prices.size() || prices[idx] != level.price, "Remove didn't find a level");
 
-    qtys[idx] -= level.qty;
-    if (qtys[idx] == 0) {
         prices.erase(prices.begin() + idx);
-        qtys.erase(qtys.begin() + idx);
+        handles.erase(handles.begin() + idx);
+        free_slots.push_back(handle);
     }
 
     if (!best_changed) {
@@ -70,9 +134,10 @@ inline BestLvlChange VectorLevelBSearchSplit<S>::remove(Level level) {
         };
     }
 
+    const Level& best = slots[handles.back()];
     return BestLvlChange{
-        .qty = qtys.back(),
-        .price = prices.back(),
+        .qty = best.qty,
+        .price = best.price,
         .side = S
     }; // return empty object as "no" change
     // no std::option used, because it provably doesn't return in registers
@@ -80,35 +145,48 @@ inline BestLvlChange VectorLevelBSearchSplit<S>::remove(Level level) {
 }
 
 template<Side S>
-inline BestLvlChange VectorLevelBSearchSplit<S>::add(Level level) {
+inline BestLvlChange VectorLevelBSearchSplit<S>::add(Level level, LevelHandle& handle) {
     const size_t old_size = prices.size();
-    auto it = std::lower_bound(
-        prices.begin(), prices.end(), level.price,
-        [](uint32_t lhs, uint32_t price) {
-            if constexpr (S == Side::Bid) {
-                return lhs < price;
-            } else {
-                return lhs > price;
-            }
-        }
-    );
-
-    size_t idx = it - prices.begin();
+    size_t idx = find_idx(level.price);
     bool best_changed = old_size == 0 || idx + 1 >= old_size;
 
-    if (it != prices.end() && *it == level.price) {
-        qtys[idx] += level.qty;
+    if (idx != old_size && prices[idx] == level.price) {
+        handle = handles[idx];
+        slots[handle].qty += level.qty;
+        slots[handle].orders += level.orders;
     } else {
-        prices.insert(it, level.price);
-        qtys.insert(qtys.begin() + idx, level.qty);
+        handle = acquire_slot(level);
+        prices.insert(prices.begin() + idx, level.price);
+        handles.insert(handles.begin() + idx, handle);
     }
 
-    return best_changed ? BestLvlChange{
-        .qty = qtys.back(),
-        .price = prices.back(),
+    if (!best_changed) {
+        return BestLvlChange{}; // same as above
+    }
+
+    const Level& best = slots[handles.back()];
+    return BestLvlChange{
+        .qty = best.qty,
+        .price = best.price,
         .side = S
+    };
+}
+
+// the prices are contiguous and get copied with a vector reverse, the qtys
+// and order counts are gathered through the handles
+template<Side S>
+inline size_t VectorLevelBSearchSplit<S>::copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const {
+    n = std::min(n, prices.size());
+    const size_t first = prices.size() - n;
+    copy_reversed(out_prices, prices.data() + first, n);
+
+    for (size_t i = 0; i < n; ++i) {
+        const Level& level = slots[handles[prices.size() - 1 - i]];
+        out_qtys[i] = level.qty;
+        out_orders[i] = level.orders;
     }
-    : BestLvlChange{}; // same as above
+
+    return n;
 }
 
 }
@@ -0,0 +1,462 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <absl/container/btree_map.h>
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+// Almost all activity of a symbol happens within a few hundred ticks of the
+// touch, so this store keeps a small dense window of qty slots (W ticks, 8KB)
+// around the best price and sends the prices outside of it to an ordered far
+// tier which is rarely touched. The window is recentred on the best price when
+// the touch drifts close to one of its edges or leaves it.
+//
+// A slot covers one tick: Cent (100, one cent) for windows centred at or above
+// 1$, 1 below that. Books which see tick indices from a PriceCodec instead of
+// ITCH prices use TickWindowLevels, where a slot is always one index. Prices
+// which are not on the tick grid of the window also go to the far tier. The
+// handle of a level is its price, so handles survive the recentring.
+//
+// The first window is centred on the reference price given to seed() (LULD
+// collar / IPO price), or on the first price added.
+//
+// The resting orders of a level are counted next to its qty, in a parallel
+// array for the window, so the depth snapshots carry them.
+
+template<Side S, uint32_t Cent>
+class WindowLevelsT {
+public:
+    static constexpr uint32_t W = 1024;
+
+    BestLvlChange add(Level level, LevelHandle& handle);
+    BestLvlChange remove(LevelHandle handle, uint64_t qty);
+
+    Level best() const;
+    LevelHandle best_handle() const;
+    bool find(uint32_t price, LevelHandle& handle) const;
+
+    void seed(uint32_t reference_price);
+
+    size_t copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const;
+
+    size_t size() const {
+        return levels;
+    }
+
+    void order_left(LevelHandle handle);
+
+    // visits every level, the window first and the far tier after it
+    template<typename F>
+    void for_each(F&& f) const {
+        for (uint32_t w = 0; w < words.size(); ++w) {
+            for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+                uint32_t off = (w << 6) | std::countr_zero(bits);
+                f(Level{qtys[off], base + off * tick, counts[off]});
+            }
+        }
+
+        for (const auto& [price, level] : far) {
+            f(Level{level.qty, price, level.orders});
+        }
+    }
+
+private:
+    static constexpr uint32_t none = W;
+    static constexpr uint32_t edge = W / 8;
+
+    struct FarLevel {
+        uint64_t qty = 0;
+        uint32_t orders = 0;
+    };
+
+    bool in_window(uint32_t price, uint32_t& off) const;
+    uint32_t window_prev(uint32_t off) const;
+    uint32_t window_next(uint32_t off) const;
+    void window_set(uint32_t off);
+    void window_clear(uint32_t off);
+
+    bool better(uint32_t lhs, uint32_t rhs) const;
+    uint64_t qty_at(uint32_t price) const;
+    void recover_best(uint32_t old_best);
+    void follow_best();
+    [[gnu::cold, gnu::noinline]] void recentre(uint32_t center);
+
+    BestLvlChange best_change() const;
+
+    alignas(64) std::array<uint64_t, W> qtys{};
+    std::array<uint32_t, W> counts{};
+    std::array<uint64_t, W / 64> words{};
+    uint64_t summary = 0;
+
+    uint32_t base = 0;
+    uint32_t tick = 1;
+    bool seeded = false;
+
+    uint32_t best_price = 0;
+    uint32_t levels = 0;
+
+    absl::btree_map<uint32_t, FarLevel> far;
+};
+
+template<Side S, uint32_t Cent>
+inline bool WindowLevelsT<S, Cent>::in_window(uint32_t price, uint32_t& off) const {
+    if (price < base) {
+        return false;
+    }
+
+    uint32_t delta = price - base;
+    if (tick == 1) {
+        off = delta;
+    } else {
+        if (delta % Cent != 0) {
+            return false;
+        }
+        off = delta / Cent;
+    }
+
+    return off < W;
+}
+
+// highest occupied offset <= off
+template<Side S, uint32_t Cent>
+inline uint32_t WindowLevelsT<S, Cent>::window_prev(uint32_t off) const {
+    uint32_t w = off >> 6;
+    uint64_t bits = words[w] & (~0ull >> (63 - (off & 63)));
+    if (bits != 0) {
+        return (w << 6) | (63 - std::countl_zero(bits));
+    }
+
+    uint64_t below = summary & ((1ull << w) - 1);
+    if (below == 0) {
+        return none;
+    }
+
+    w = 63 - std::countl_zero(below);
+    return (w << 6) | (63 - std::countl_zero(words[w]));
+}
+
+// lowest occupied offset >= off
+template<Side S, uint32_t Cent>
+inline uint32_t WindowLevelsT<S, Cent>::window_next(uint32_t off) const {
+    if (off >= W) {
+        return none;
+    }
+
+    uint32_t w = off >> 6;
+    uint64_t bits = words[w] & (~0ull << (off & 63));
+    if (bits != 0) {
+        return (w << 6) | std::countr_zero(bits);
+    }
+
+    uint64_t above = summary & (~0ull << (w + 1));
+    if (above == 0) {
+        return none;
+    }
+
+    w = std::countr_zero(above);
+    return (w << 6) | std::countr_zero(words[w]);
+}
+
+template<Side S, uint32_t Cent>
+inline void WindowLevelsT<S, Cent>::window_set(uint32_t off) {
+    words[off >> 6] |= 1ull << (off & 63);
+    summary |= 1ull << (off >> 6);
+}
+
+template<Side S, uint32_t Cent>
+inline void WindowLevelsT<S, Cent>::window_clear(uint32_t off) {
+    uint64_t& word = words[off >> 6];
+    word &= ~(1ull << (off & 63));
+    if (word == 0) {
+        summary &= ~(1ull << (off >> 6));
+    }
+}
+
+template<Side S, uint32_t Cent>
+inline bool WindowLevelsT<S, Cent>::better(uint32_t lhs, uint32_t rhs) const {
+    if constexpr (S == Side::Bid) {
+        return lhs > rhs;
+    } else {
+        return lhs < rhs;
+    }
+}
+
+template<Side S, uint32_t Cent>
+inline uint64_t WindowLevelsT<S, Cent>::qty_at(uint32_t price) const {
+    uint32_t off;
+    if (in_window(price, off)) [[likely]] {
+        return qtys[off];
+    }
+
+    auto it = far.find(price);
+    return it == far.end() ? 0 : it->second.qty;
+}
+
+template<Side S, uint32_t Cent>
+inline BestLvlChange WindowLevelsT<S, Cent>::best_change() const {
+    if (levels == 0) {
+        return BestLvlChange{
+            .qty = 0,
+            .price = 0,
+            .side = S
+        };
+    }
+
+    return BestLvlChange{
+        .qty = qty_at(best_price),
+        .price = best_price,
+        .side = S
+    };
+}
+
+// keeps the best price away from the edges of the window
+template<Side S, uint32_t Cent>
+inline void WindowLevelsT<S, Cent>::follow_best() {
+    uint32_t off;
+    if (!in_window(best_price, off) || off < edge || off >= W - edge) [[unlikely]] {
+        recentre(best_price);
+    }
+}
+
+template<Side S, uint32_t Cent>
+void WindowLevelsT<S, Cent>::recentre(uint32_t center) {
+    // spill the whole window to the far tier and pull the new range back in,
+    // this happens once per few hundred ticks of drift
+    for (uint32_t w = 0; w < words.size(); ++w) {
+        while (words[w] != 0) {
+            uint32_t off = (w << 6) | std::countr_zero(words[w]);
+            FarLevel& level = far[base + off * tick];
+            level.qty += qtys[off];
+            level.orders += counts[off];
+            qtys[off] = 0;
+            counts[off] = 0;
+            words[w] &= words[w] - 1;
+        }
+    }
+    summary = 0;
+
+    tick = center >= 10'000 ? Cent : 1;
+    uint32_t half = W / 2 * tick;
+    base = center > half ? center - half : 0;
+    base -= base % tick;
+    seeded = true;
+
+    uint64_t end = uint64_t(base) + uint64_t(W) * tick;
+    for (auto it = far.lower_bound(base); it != far.end() && it->first < end;) {
+        uint32_t off;
+        if (in_window(it->first, off)) {
+            qtys[off] = it->second.qty;
+            counts[off] = it->second.orders;
+            window_set(off);
+            it = far.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+template<Side S, uint32_t Cent>
+inline void WindowLevelsT<S, Cent>::seed(uint32_t reference_price) {
+    if (levels == 0) {
+        recentre(reference_price);
+    }
+}
+
+template<Side S, uint32_t Cent>
+inline BestLvlChange WindowLevelsT<S, Cent>::add(Level level, LevelHandle& handle) {
+    handle = level.price;
+    if (!seeded) [[unlikely]] {
+        recentre(level.price);
+    }
+
+    bool best_changed = levels == 0 || !better(best_price, level.price);
+
+    uint32_t off;
+    if (in_window(level.price, off)) [[likely]] {
+        if (qtys[off] == 0) {
+            window_set(off);
+            levels++;
+        }
+        qtys[off] += level.qty;
+        counts[off] += level.orders;
+    } else {
+        FarLevel& far_level = far[level.price];
+        if (far_level.qty == 0) {
+            levels++;
+        }
+        far_level.qty += level.qty;
+        far_level.orders += level.orders;
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    best_price = level.price;
+    follow_best();
+    return best_change();
+}
+
+template<Side S, uint32_t Cent>
+inline void WindowLevelsT<S, Cent>::recover_best(uint32_t old_best) {
+    if (levels == 0) {
+        return;
+    }
+
+    // the old best may be off the tick grid, so search from its position in
+    // the window rather than from its slot
+    uint32_t candidate_off = none;
+    if constexpr (S == Side::Bid) {
+        if (old_best > base) {
+            uint64_t last = (uint64_t(old_best) - base - 1) / tick;
+            candidate_off = window_prev(uint32_t(std::min<uint64_t>(last, W - 1)));
+        }
+    } else {
+        uint64_t first = old_best < base ? 0 : (uint64_t(old_best) - base) / tick + 1;
+        candidate_off = window_next(uint32_t(std::min<uint64_t>(first, W)));
+    }
+
+    bool found = candidate_off != none;
+    if (found) {
+        best_price = base + candidate_off * tick;
+    }
+
+    if (!far.empty()) {
+        uint32_t far_best;
+        if constexpr (S == Side::Bid) {
+            far_best = far.rbegin()->first;
+        } else {
+            far_best = far.begin()->first;
+        }
+
+        if (!found || better(far_best, best_price)) {
+            best_price = far_best;
+        }
+    }
+
+    follow_best();
+}
+
+template<Side S, uint32_t Cent>
+inline BestLvlChange WindowLevelsT<S, Cent>::remove(LevelHandle handle, uint64_t qty) {
+    bool best_changed = levels != 0 && handle == best_price;
+    bool emptied = false;
+
+    uint32_t off;
+    if (in_window(handle, off)) [[likely]] {
+        UNEXPECTED(qty > qtys[off], "Remove underflow");
+        qtys[off] -= qty;
+        if (qtys[off] == 0) {
+            window_clear(off);
+            counts[off] = 0;
+            emptied = true;
+        }
+    } else {
+        auto it = far.find(handle);
+        UNEXPECTED(it == far.end(), "Remove didn't find a level");
+        UNEXPECTED(qty > it->second.qty, "Remove underflow");
+
+        it->second.qty -= qty;
+        if (it->second.qty == 0) {
+            far.erase(it);
+            emptied = true;
+        }
+    }
+
+    if (emptied) {
+        levels--;
+    }
+
+    if (!best_changed) {
+        return BestLvlChange{};
+    }
+
+    if (emptied) {
+        recover_best(handle);
+    }
+
+    return best_change();
+}
+
+template<Side S, uint32_t Cent>
+inline void WindowLevelsT<S, Cent>::order_left(LevelHandle handle) {
+    uint32_t off;
+    if (in_window(handle, off)) [[likely]] {
+        counts[off]--;
+    } else {
+        far.find(handle)->second.orders--;
+    }
+}
+
+template<Side S, uint32_t Cent>
+inline Level WindowLevelsT<S, Cent>::best() const {
+    if (levels == 0) {
+        return {0, 0};
+    }
+
+    return {qty_at(best_price), best_price};
+}
+
+template<Side S, uint32_t Cent>
+inline LevelHandle WindowLevelsT<S, Cent>::best_handle() const {
+    UNEXPECTED(levels == 0, "Best handle on an empty side");
+    return best_price;
+}
+
+template<Side S, uint32_t Cent>
+inline bool WindowLevelsT<S, Cent>::find(uint32_t price, LevelHandle& handle) const {
+    if (qty_at(price) == 0) {
+        return false;
+    }
+
+    handle = price;
+    return true;
+}
+
+
+// the window and the far tier are each sorted, merge them from the best price
+template<Side S, uint32_t Cent>
+inline size_t WindowLevelsT<S, Cent>::copy_top(size_t n, uint64_t* out_qtys, uint32_t* out_prices, uint32_t* out_orders) const {
+    uint32_t off = S == Side::Bid ? window_prev(W - 1) : window_next(0);
+
+    auto merge = [&](auto it, auto end) {
+        size_t count = 0;
+        while (count < n && (off != none || it != end)) {
+            uint32_t price = base + off * tick;
+            if (off != none && (it == end || better(price, it->first))) {
+                out_qtys[count] = qtys[off];
+                out_prices[count] = price;
+                out_orders[count] = counts[off];
+                if constexpr (S == Side::Bid) {
+                    off = off == 0 ? none : window_prev(off - 1);
+                } else {
+                    off = window_next(off + 1);
+                }
+            } else {
+                out_qtys[count] = it->second.qty;
+                out_prices[count] = it->first;
+                out_orders[count] = it->second.orders;
+                ++it;
+            }
+            count++;
+        }
+        return count;
+    };
+
+    if constexpr (S == Side::Bid) {
+        return merge(far.rbegin(), far.rend());
+    } else {
+        return merge(far.begin(), far.end());
+    }
+}
+
+template<Side S>
+using WindowLevels = WindowLevelsT<S, 100>;
+
+template<Side S>
+using TickWindowLevels = WindowLevelsT<S, 1>;
+
+}
@@ -0,0 +1,250 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "depth_snapshot.hpp"
+#include "order_book_shared.hpp"
+#include "levels/vector_levels_b_search_split.hpp"
+#include "orders/paged_order_table.hpp"
+
+namespace OB {
+
+// Order reference numbers are unique across the whole feed, so a book over
+// the full market keeps all the orders in one shared table and every order
+// carries the locate of the instrument it rests in. Compared to a table per
+// instrument this avoids thousands of half empty tables and their rehashes.
+struct MarketOrder {
+    uint32_t qty;
+    uint32_t price;
+    LevelHandle level;
+    uint16_t locate;
+    Side side;
+};
+
+static_assert(sizeof(MarketOrder) == 16);
+
+// Full market book: one pre-sized order table for every instrument and a pair
+// of level stores per locate, created when the first order of the instrument
+// arrives. The level stores start small, most of the market is thin.
+template<
+    template<Side> typename Levels = VectorLevelBSearchSplit,
+    typename Orders = PagedOrderTable<MarketOrder, 12, 14>
+>
+class MarketOrderBook {
+public:
+    static constexpr size_t max_locates = 65536;
+    static constexpr size_t level_capacity = 16;
+
+    explicit MarketOrderBook(size_t expected_orders = 4'000'000) : instruments(max_locates) {
+        orders_map.reserve(expected_orders);
+    }
+
+    BestLvlChange add_order(uint16_t locate, uint64_t order_id, Side side, uint32_t qty, uint32_t price);
+    BestLvlChange cancel_order(uint64_t order_id, uint32_t qty);
+    BestLvlChange execute_order(uint64_t order_id, uint32_t qty);
+    BestLvlChange replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price);
+    BestLvlChange delete_order(uint64_t order_id);
+
+    Level best_bid(uint16_t locate);
+    Level best_ask(uint16_t locate);
+
+    template<size_t N>
+    DepthSnapshot<N> depth(uint16_t locate) const;
+
+    // issued ahead of the operation on order_id, the shared table is where a
+    // full market book misses the cache
+    void prefetch_order(uint64_t order_id) const {
+        orders_map.prefetch(order_id);
+    }
+
+    size_t instruments_count() const {
+        return instruments_count_;
+    }
+
+    // memory of the level stores, the order table not included
+    size_t level_bytes() const {
+        size_t bytes = instruments.capacity() * sizeof(instruments[0]) + instruments_count_ * sizeof(Instrument);
+        if constexpr (requires { Levels<Side::Bid>::arena_bytes(); }) {
+            bytes += Levels<Side::Bid>::arena_bytes();
+        }
+        return bytes;
+    }
+
+    uint64_t max_orders = 0;
+    Orders orders_map;
+
+private:
+    template<Side S>
+    static Levels<S> make_levels() {
+        if constexpr (std::is_constructible_v<Levels<S>, size_t>) {
+            return Levels<S>(level_capacity);
+        } else {
+            return Levels<S>();
+        }
+    }
+
+    struct Instrument {
+        Levels<Side::Bid> bid = make_levels<Side::Bid>();
+        Levels<Side::Ask> ask = make_levels<Side::Ask>();
+    };
+
+    Instrument& instrument(uint16_t locate);
+    BestLvlChange remove_level(const MarketOrder& order, uint32_t qty);
+
+    std::vector<std::unique_ptr<Instrument>> instruments;
+    size_t instruments_count_ = 0;
+};
+
+template<template<Side> typename Levels, typename Orders>
+inline typename MarketOrderBook<Levels, Orders>::Instrument&
+MarketOrderBook<Levels, Orders>::instrument(uint16_t locate) {
+    auto& instrument = instruments[locate];
+    if (instrument == nullptr) [[unlikely]] {
+        instrument = std::make_unique<Instrument>();
+        instruments_count_++;
+    }
+
+    return *instrument;
+}
+
+template<template<Side> typename Levels, typename Orders>
+Level MarketOrderBook<Levels, Orders>::best_bid(uint16_t locate) {
+    return instruments[locate] == nullptr ? Level{0, 0} : instruments[locate]->bid.best();
+}
+
+template<template<Side> typename Levels, typename Orders>
+Level MarketOrderBook<Levels, Orders>::best_ask(uint16_t locate) {
+    return instruments[locate] == nullptr ? Level{0, 0} : instruments[locate]->ask.best();
+}
+
+template<template<Side> typename Levels, typename Orders>
+template<size_t N>
+DepthSnapshot<N> MarketOrderBook<Levels, Orders>::depth(uint16_t locate) const {
+    DepthSnapshot<N> snapshot;
+    if (instruments[locate] != nullptr) {
+        fill_depth(instruments[locate]->bid, snapshot.bid);
+        fill_depth(instruments[locate]->ask, snapshot.ask);
+    }
+    return snapshot;
+}
+
+template<template<Side> typename Levels, typename Orders>
+inline BestLvlChange MarketOrderBook<Levels, Orders>::remove_level(const MarketOrder& order, uint32_t qty) {
+    Instrument& levels = *instruments[order.locate];
+    if (order.side == Side::Bid) {
+        if (order.qty == qty) {
+            order_left(levels.bid, order.level);
+        }
+        return levels.bid.remove(order.level, qty);
+    } else {
+        if (order.qty == qty) {
+            order_left(levels.ask, order.level);
+        }
+        return levels.ask.remove(order.level, qty);
+    }
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange MarketOrderBook<Levels, Orders>::add_order(uint16_t locate, uint64_t order_id, Side side, uint32_t qty, uint32_t price) {
+    MarketOrder order;
+    order.qty = qty;
+    order.price = price;
+    order.locate = locate;
+    order.side = side;
+
+    Instrument& levels = instrument(locate);
+
+    BestLvlChange best_lvl_change;
+    if (side == Side::Bid) {
+        best_lvl_change = levels.bid.add({qty, price, 1}, order.level);
+    } else {
+        best_lvl_change = levels.ask.add({qty, price, 1}, order.level);
+    }
+
+    orders_map.insert(order_id, order);
+
+    return best_lvl_change;
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange MarketOrderBook<Levels, Orders>::cancel_order(uint64_t order_id, uint32_t qty) {
+    MarketOrder* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Cancel order did not find an order");
+    MarketOrder& order = *order_ptr;
+    UNEXPECTED(order.qty < qty, "Partial cancel order volume greater than order volume");
+
+    BestLvlChange best_lvl_change = remove_level(order, qty);
+
+    order.qty -= qty;
+    if (order.qty == 0) {
+        orders_map.erase(order_id);
+    }
+
+    return best_lvl_change;
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange MarketOrderBook<Levels, Orders>::execute_order(uint64_t order_id, uint32_t qty) {
+    MarketOrder* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Execute order did not find an order");
+    MarketOrder& order = *order_ptr;
+    UNEXPECTED(order.qty < qty, "Partial execute order volume greater than order volume");
+
+    BestLvlChange best_lvl_change = remove_level(order, qty);
+
+    order.qty -= qty;
+    if (order.qty == 0) {
+        orders_map.erase(order_id);
+    }
+
+    return best_lvl_change;
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange MarketOrderBook<Levels, Orders>::replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price) {
+    MarketOrder* old_order_ptr = orders_map.find(order_id);
+    UNEXPECTED(old_order_ptr == nullptr, "Replace order did not find an order");
+    MarketOrder& old_order = *old_order_ptr;
+
+    MarketOrder new_order;
+    new_order.qty = qty;
+    new_order.price = price;
+    new_order.locate = old_order.locate;
+    new_order.side = old_order.side;
+
+    Instrument& levels = *instruments[old_order.locate];
+
+    BestLvlChange best_change_rem{};
+    BestLvlChange best_change_add{};
+
+    if (new_order.side == Side::Bid) {
+        order_left(levels.bid, old_order.level);
+        best_change_rem = levels.bid.remove(old_order.level, old_order.qty);
+        best_change_add = levels.bid.add({qty, price, 1}, new_order.level);
+    } else {
+        order_left(levels.ask, old_order.level);
+        best_change_rem = levels.ask.remove(old_order.level, old_order.qty);
+        best_change_add = levels.ask.add({qty, price, 1}, new_order.level);
+    }
+
+    orders_map.erase(order_id);
+    orders_map.insert(new_order_id, new_order);
+
+    if (best_change_add.side != Side::None) {
+        return best_change_add;
+    } else return best_change_rem;
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange MarketOrderBook<Levels, Orders>::delete_order(uint64_t order_id) {
+    MarketOrder* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Delete order did not find an order");
+
+    BestLvlChange best_lvl_change = remove_level(*order_ptr, order_ptr->qty);
+
+    orders_map.erase(order_id);
+    return best_lvl_change;
+}
+
+}
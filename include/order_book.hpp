@@ -1,11 +1,13 @@
 #pragma once
+#include <array>
 #include <cstdint>
-#include <absl/container/flat_hash_map.h>
+#include "depth_snapshot.hpp"
 #include "order_book_shared.hpp"
+#include "orders/hash_order_table.hpp"
 
 namespace OB {
 
-template<template<Side> typename Levels>
+template<template<Side> typename Levels, typename Orders = HashOrderTable<>>
 class OrderBook {
 public:
     BestLvlChange add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price);
@@ -17,129 +19,238 @@ public:
     Level best_bid();
     Level best_ask();
 
+    template<size_t N>
+    DepthSnapshot<N> depth() const;
+
+    void idle();
+    void seed_reference_price(uint32_t price);
+
+    // moves every resting order and its level to map(price), map has to keep
+    // the prices in order. Walks the order table twice, see TickOrderBook
+    template<typename F>
+    void reprice(F&& map);
+
+    // issued ahead of the operation on order_id, see Handler::prefetch
+    void prefetch_order(uint64_t order_id) const {
+        orders_map.prefetch(order_id);
+    }
+
+    // the level changes of the last operation: deltas[0] for an add, cancel,
+    // execute or delete, a replace leaves its removal in deltas[0] and its add
+    // in deltas[1]
+    std::array<LevelDelta, 2> deltas;
+
     uint64_t max_orders = 0;
-    absl::flat_hash_map<uint64_t, Order> orders_map;
+    Orders orders_map;
     Levels<Side::Bid> bid_levels;
     Levels<Side::Ask> ask_levels;
 };
 
-template<template<Side> typename Levels>
- Level OrderBook<Levels>::best_bid() {
+template<template<Side> typename Levels, typename Orders>
+ Level OrderBook<Levels, Orders>::best_bid() {
     return bid_levels.best();
 }
 
-template<template<Side> typename Levels>
- Level OrderBook<Levels>::best_ask() {
+template<template<Side> typename Levels, typename Orders>
+ Level OrderBook<Levels, Orders>::best_ask() {
     return ask_levels.best();
 }
 
-template<template<Side> typename Levels>
-BestLvlChange OrderBook<Levels>::add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price) {
+// top N levels of both sides, best first
+template<template<Side> typename Levels, typename Orders>
+template<size_t N>
+DepthSnapshot<N> OrderBook<Levels, Orders>::depth() const {
+    DepthSnapshot<N> snapshot;
+    fill_depth(bid_levels, snapshot.bid);
+    fill_depth(ask_levels, snapshot.ask);
+    return snapshot;
+}
+
+// housekeeping the level stores defer to the moments ingest is idle: the
+// paged ladders give back their empty pages, the gap levels drop tombstones
+template<template<Side> typename Levels, typename Orders>
+void OrderBook<Levels, Orders>::idle() {
+    if constexpr (requires { bid_levels.release_empty_pages(); }) {
+        bid_levels.release_empty_pages();
+        ask_levels.release_empty_pages();
+    }
+
+    if constexpr (requires { bid_levels.compact(); }) {
+        bid_levels.compact();
+        ask_levels.compact();
+    }
+}
+
+// lets the windowed level stores centre on a reference price before the first
+// order of the instrument arrives
+template<template<Side> typename Levels, typename Orders>
+void OrderBook<Levels, Orders>::seed_reference_price(uint32_t price) {
+    if constexpr (requires { bid_levels.seed(price); }) {
+        bid_levels.seed(price);
+        ask_levels.seed(price);
+    }
+}
+
+// the first pass empties the level stores, the second adds the orders back at
+// their new prices, so a store never holds both kinds of prices
+template<template<Side> typename Levels, typename Orders>
+template<typename F>
+void OrderBook<Levels, Orders>::reprice(F&& map) {
+    orders_map.for_each([&](Order& order) {
+        if (order.side == Side::Bid) {
+            order_left(bid_levels, order.level);
+            bid_levels.remove(order.level, order.qty);
+        } else {
+            order_left(ask_levels, order.level);
+            ask_levels.remove(order.level, order.qty);
+        }
+    });
+
+    orders_map.for_each([&](Order& order) {
+        order.price = map(order.price);
+        if (order.side == Side::Bid) {
+            bid_levels.add({order.qty, order.price, 1}, order.level);
+        } else {
+            ask_levels.add({order.qty, order.price, 1}, order.level);
+        }
+    });
+}
+
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange OrderBook<Levels, Orders>::add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price) {
     Order order;
     order.qty = qty;
     order.side = side;
     order.price = price;
-    orders_map.insert({order_id, order});
+
+    deltas[0] = {int64_t(qty), price, 1, side};
 
     BestLvlChange best_lvl_change;
     if (side == Side::Bid) {
-        best_lvl_change = bid_levels.add({qty, price});
+        best_lvl_change = bid_levels.add({qty, price, 1}, order.level);
     } else {
-        best_lvl_change = ask_levels.add({qty, price});
+        best_lvl_change = ask_levels.add({qty, price, 1}, order.level);
     }
 
+    orders_map.insert(order_id, order);
+
     return best_lvl_change;
 }
 
-template<template<Side> typename Levels>
-BestLvlChange OrderBook<Levels>::cancel_order(uint64_t order_id, uint32_t qty) {
-    auto it = orders_map.find(order_id);
-    UNEXPECTED(it == orders_map.end(), "Cancel order did not find an order");
-    Order& order = it->second;
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange OrderBook<Levels, Orders>::cancel_order(uint64_t order_id, uint32_t qty) {
+    Order* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Cancel order did not find an order");
+    Order& order = *order_ptr;
     UNEXPECTED(order.qty < qty, "Partial cancel order volume greater than order volume");
 
+    deltas[0] = {-int64_t(qty), order.price, int8_t(order.qty == qty ? -1 : 0), order.side};
+
     BestLvlChange best_lvl_change;
     if (order.side == Side::Bid) {
-        best_lvl_change = bid_levels.remove({qty, order.price});
+        if (order.qty == qty) {
+            order_left(bid_levels, order.level);
+        }
+        best_lvl_change = bid_levels.remove(order.level, qty);
     } else {
-        best_lvl_change = ask_levels.remove({qty, order.price});
+        if (order.qty == qty) {
+            order_left(ask_levels, order.level);
+        }
+        best_lvl_change = ask_levels.remove(order.level, qty);
     }
 
     order.qty -= qty;
     if (order.qty == 0) {
-        orders_map.erase(it);
+        orders_map.erase(order_id);
     }
 
     return best_lvl_change;
 }
 
-template<template<Side> typename Levels>
-BestLvlChange OrderBook<Levels>::execute_order(uint64_t order_id, uint32_t qty) {
-    auto it = orders_map.find(order_id);
-    UNEXPECTED(it == orders_map.end(), "Execute order did not find an order");
-    Order& order = it->second;
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange OrderBook<Levels, Orders>::execute_order(uint64_t order_id, uint32_t qty) {
+    Order* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Execute order did not find an order");
+    Order& order = *order_ptr;
     UNEXPECTED(order.qty < qty, "Partial execute order volume greater than order volume");
 
+    deltas[0] = {-int64_t(qty), order.price, int8_t(order.qty == qty ? -1 : 0), order.side};
+
     BestLvlChange best_lvl_change;
     if (order.side == Side::Bid) {
-        best_lvl_change = bid_levels.remove({qty, order.price});
+        if (order.qty == qty) {
+            order_left(bid_levels, order.level);
+        }
+        best_lvl_change = bid_levels.remove(order.level, qty);
     } else {
-        best_lvl_change = ask_levels.remove({qty, order.price});
+        if (order.qty == qty) {
+            order_left(ask_levels, order.level);
+        }
+        best_lvl_change = ask_levels.remove(order.level, qty);
     }
 
     order.qty -= qty;
     if (order.qty == 0) {
-        orders_map.erase(it);
+        orders_map.erase(order_id);
     }
 
     return best_lvl_change;
 }
 
-template<template<Side> typename Levels>
-BestLvlChange OrderBook<Levels>::replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price) {
-    auto it = orders_map.find(order_id);
-    UNEXPECTED(it == orders_map.end(), "Replace order did not find an order");
-    Order& old_order = it->second;
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange OrderBook<Levels, Orders>::replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price) {
+    Order* old_order_ptr = orders_map.find(order_id);
+    UNEXPECTED(old_order_ptr == nullptr, "Replace order did not find an order");
+    Order& old_order = *old_order_ptr;
 
     Order new_order;
     new_order.side = old_order.side;
     new_order.price = price;
     new_order.qty = qty;
 
+    deltas[0] = {-int64_t(old_order.qty), old_order.price, -1, old_order.side};
+    deltas[1] = {int64_t(qty), price, 1, new_order.side};
+
     BestLvlChange best_change_rem{};
     BestLvlChange best_change_add{};
 
     if (new_order.side == Side::Bid) {
-        best_change_rem = bid_levels.remove({old_order.qty, old_order.price});
-        best_change_add = bid_levels.add({qty, price});
+        order_left(bid_levels, old_order.level);
+        best_change_rem = bid_levels.remove(old_order.level, old_order.qty);
+        best_change_add = bid_levels.add({qty, price, 1}, new_order.level);
     } else {
-        best_change_rem = ask_levels.remove({old_order.qty, old_order.price});
-        best_change_add = ask_levels.add({qty, price});
+        order_left(ask_levels, old_order.level);
+        best_change_rem = ask_levels.remove(old_order.level, old_order.qty);
+        best_change_add = ask_levels.add({qty, price, 1}, new_order.level);
     }
 
-    orders_map.erase(it);
-    orders_map.emplace(new_order_id, new_order);
+    orders_map.erase(order_id);
+    orders_map.insert(new_order_id, new_order);
 
     if (best_change_add.side != Side::None) {
         return best_change_add;
     } else return best_change_rem;
 }
 
-template<template<Side> typename Levels>
-BestLvlChange OrderBook<Levels>::delete_order(uint64_t order_id) {
-    auto it = orders_map.find(order_id);
-    UNEXPECTED(it == orders_map.end(), "Delete order did not find an order");
+template<template<Side> typename Levels, typename Orders>
+BestLvlChange OrderBook<Levels, Orders>::delete_order(uint64_t order_id) {
+    Order* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Delete order did not find an order");
+
+    Order& order = *order_ptr;
 
-    Order& order = it->second;
+    deltas[0] = {-int64_t(order.qty), order.price, -1, order.side};
 
     BestLvlChange best_lvl_change;
     if (order.side == Side::Bid) {
-        best_lvl_change = bid_levels.remove({order.qty, order.price});
+        order_left(bid_levels, order.level);
+        best_lvl_change = bid_levels.remove(order.level, order.qty);
     } else {
-        best_lvl_change = ask_levels.remove({order.qty, order.price});
+        order_left(ask_levels, order.level);
+        best_lvl_change = ask_levels.remove(order.level, order.qty);
     }
 
-    orders_map.erase(it);
+    orders_map.erase(order_id);
     return best_lvl_change;
 }
 
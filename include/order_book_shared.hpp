@@ -7,26 +7,62 @@ namespace OB {
 struct Level {
     uint64_t qty;
     uint32_t price;
+    // resting orders, lives in the padding and is only kept by the level stores
+    // which hold a Level per slot, the books add levels with one order each
+    uint32_t orders = 0;
 };
 
+static_assert(sizeof(Level) == 16);
+
 enum class Side : char {
     None = 0,
     Bid = 'B',
     Ask = 'S'
 };
 
+// handed out by the level stores on add, identifies the level an order rests
+// on so cancels, executes and deletes don't have to search for the price again
+using LevelHandle = uint32_t;
+
 struct Order {
     uint32_t qty;
     uint32_t price;
+    LevelHandle level;
     Side side;
+    // the level store generation the handle belongs to, lives in the padding
+    // and is only used by the books which swap their level stores
+    uint8_t generation = 0;
 };
 
+static_assert(sizeof(Order) == 16);
+
+// change of one price level made by one book operation. Consumers keep their
+// own copy of the levels by applying the deltas in order, a level appears with
+// its first delta and goes away when its qty gets back to zero.
+struct LevelDelta {
+    int64_t qty;   // added to the qty of the level
+    uint32_t price;
+    int8_t orders; // +1 an order joined the level, -1 one left it, 0 partial
+    Side side;
+};
+
+static_assert(sizeof(LevelDelta) == 16);
+
 struct BestLvlChange {
     uint64_t qty;
     uint32_t price;
     Side side;
 };
 
+// tells the level store an order left the level for good, before the qty of
+// the order is removed from it. A no-op for the stores which don't count orders.
+template<typename Levels>
+inline void order_left(Levels& levels, LevelHandle handle) {
+    if constexpr (requires { levels.order_left(handle); }) {
+        levels.order_left(handle);
+    }
+}
+
 [[gnu::cold, gnu::noinline]]
 static void abort_unexpected(std::string_view message) {
     std::cerr << message << '\n';
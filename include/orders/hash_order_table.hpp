@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <absl/container/flat_hash_map.h>
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+template<typename T = Order>
+class HashOrderTable {
+public:
+    T* find(uint64_t order_id);
+    void insert(uint64_t order_id, const T& order);
+    void erase(uint64_t order_id);
+
+    // pulls in the slots a find or an insert of order_id probes first
+    void prefetch(uint64_t order_id) const {
+        orders.prefetch(order_id);
+    }
+
+    void reserve(size_t orders_count) {
+        orders.reserve(orders_count);
+    }
+
+    size_t size() const {
+        return orders.size();
+    }
+
+    // every live order, in no particular order
+    template<typename F>
+    void for_each(F&& f) {
+        for (auto& [order_id, order] : orders) {
+            f(order);
+        }
+    }
+
+private:
+    absl::flat_hash_map<uint64_t, T> orders;
+};
+
+template<typename T>
+inline T* HashOrderTable<T>::find(uint64_t order_id) {
+    auto it = orders.find(order_id);
+    if (it == orders.end()) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+template<typename T>
+inline void HashOrderTable<T>::insert(uint64_t order_id, const T& order) {
+    orders.insert({order_id, order});
+}
+
+template<typename T>
+inline void HashOrderTable<T>::erase(uint64_t order_id) {
+    orders.erase(order_id);
+}
+
+}
@@ -0,0 +1,236 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <absl/container/flat_hash_map.h>
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+// ITCH order reference numbers are assigned in a roughly increasing sequence
+// over the day, so instead of hashing the table keeps a sliding window of
+// pages indexed directly by (order_id >> PageBits) - base_page. Pages are
+// allocated on demand and recycled as soon as every order in them is gone.
+// When a new order id lands past the window the window slides forward and
+// whatever is still alive in the pages falling out of it (long lived orders,
+// outliers) is moved to the overflow hash map.
+//
+// T is the stored order (OB::Order for the aggregated book) and needs a side
+// member. An empty slot is marked with Side::None, which is why value
+// initialized pages need no further setup.
+
+template<typename T = Order, size_t PageBits = 9, size_t WindowBits = 13>
+class PagedOrderTable {
+public:
+    PagedOrderTable() {
+        directory.fill(nullptr);
+    }
+
+    T* find(uint64_t order_id);
+    void insert(uint64_t order_id, const T& order);
+    void erase(uint64_t order_id);
+
+    // pulls in the slot of order_id, the overflow is left alone
+    void prefetch(uint64_t order_id) const {
+        uint64_t page_idx = order_id >> PageBits;
+        if (page_idx - base_page < window_pages) {
+            const Page* page = directory[page_idx & window_mask];
+            if (page != nullptr) {
+                __builtin_prefetch(&page->slots[order_id & slot_mask]);
+            }
+        }
+    }
+
+    // allocates the pages for that many live orders up front
+    void reserve(size_t orders_count);
+
+    size_t size() const {
+        return size_;
+    }
+
+    // every live order, in no particular order
+    template<typename F>
+    void for_each(F&& f) {
+        for (Page* page : directory) {
+            if (page == nullptr) {
+                continue;
+            }
+            for (T& order : page->slots) {
+                if (order.side != Side::None) {
+                    f(order);
+                }
+            }
+        }
+        for (auto& [order_id, order] : overflow) {
+            f(order);
+        }
+    }
+
+    size_t pages_in_use() const {
+        return page_storage.size() - free_pages.size();
+    }
+
+    size_t overflow_size() const {
+        return overflow.size();
+    }
+
+private:
+    static constexpr uint64_t page_size = 1ull << PageBits;
+    static constexpr uint64_t slot_mask = page_size - 1;
+    static constexpr uint64_t window_pages = 1ull << WindowBits;
+    static constexpr uint64_t window_mask = window_pages - 1;
+
+    struct alignas(64) Page {
+        std::array<T, page_size> slots{};
+        uint32_t live = 0;
+    };
+
+    Page* acquire_page();
+    void release_page(Page* page);
+    [[gnu::cold, gnu::noinline]] void slide_window(uint64_t page_idx);
+
+    uint64_t base_page = 0;
+    size_t size_ = 0;
+    std::array<Page*, window_pages> directory;
+
+    std::vector<Page*> free_pages;
+    std::vector<std::unique_ptr<Page>> page_storage;
+    absl::flat_hash_map<uint64_t, T> overflow;
+};
+
+template<typename T, size_t PageBits, size_t WindowBits>
+inline T* PagedOrderTable<T, PageBits, WindowBits>::find(uint64_t order_id) {
+    uint64_t page_idx = order_id >> PageBits;
+
+    // unsigned wrap around also sends ids below the window to the overflow
+    if (page_idx - base_page < window_pages) [[likely]] {
+        Page* page = directory[page_idx & window_mask];
+        if (page == nullptr) {
+            return nullptr;
+        }
+
+        T& order = page->slots[order_id & slot_mask];
+        return order.side != Side::None ? &order : nullptr;
+    }
+
+    auto it = overflow.find(order_id);
+    if (it == overflow.end()) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+template<typename T, size_t PageBits, size_t WindowBits>
+inline void PagedOrderTable<T, PageBits, WindowBits>::insert(uint64_t order_id, const T& order) {
+    UNEXPECTED(order.side == Side::None, "Inserted order has no side");
+    uint64_t page_idx = order_id >> PageBits;
+
+    if (page_idx - base_page >= window_pages) [[unlikely]] {
+        if (page_idx < base_page) {
+            overflow.insert({order_id, order});
+            size_++;
+            return;
+        }
+
+        slide_window(page_idx);
+    }
+
+    Page*& page = directory[page_idx & window_mask];
+    if (page == nullptr) {
+        page = acquire_page();
+    }
+
+    T& slot = page->slots[order_id & slot_mask];
+    UNEXPECTED(slot.side != Side::None, "Order id inserted twice");
+
+    slot = order;
+    page->live++;
+    size_++;
+}
+
+template<typename T, size_t PageBits, size_t WindowBits>
+inline void PagedOrderTable<T, PageBits, WindowBits>::erase(uint64_t order_id) {
+    uint64_t page_idx = order_id >> PageBits;
+
+    if (page_idx - base_page < window_pages) [[likely]] {
+        Page*& page = directory[page_idx & window_mask];
+        UNEXPECTED(page == nullptr, "Erase did not find an order page");
+
+        T& slot = page->slots[order_id & slot_mask];
+        UNEXPECTED(slot.side == Side::None, "Erase did not find an order");
+
+        slot = T{};
+        size_--;
+
+        if (--page->live == 0) {
+            release_page(page);
+            page = nullptr;
+        }
+        return;
+    }
+
+    size_t erased = overflow.erase(order_id);
+    UNEXPECTED(erased == 0, "Erase did not find an order");
+    size_--;
+}
+
+template<typename T, size_t PageBits, size_t WindowBits>
+void PagedOrderTable<T, PageBits, WindowBits>::reserve(size_t orders_count) {
+    size_t pages = std::min<size_t>((orders_count + page_size - 1) / page_size, window_pages);
+    while (page_storage.size() < pages) {
+        page_storage.push_back(std::make_unique<Page>());
+        free_pages.push_back(page_storage.back().get());
+    }
+}
+
+template<typename T, size_t PageBits, size_t WindowBits>
+inline typename PagedOrderTable<T, PageBits, WindowBits>::Page*
+PagedOrderTable<T, PageBits, WindowBits>::acquire_page() {
+    if (!free_pages.empty()) {
+        Page* page = free_pages.back();
+        free_pages.pop_back();
+        return page;
+    }
+
+    page_storage.push_back(std::make_unique<Page>());
+    return page_storage.back().get();
+}
+
+template<typename T, size_t PageBits, size_t WindowBits>
+inline void PagedOrderTable<T, PageBits, WindowBits>::release_page(Page* page) {
+    // every slot has been reset by erase, so the page can be reused as is
+    free_pages.push_back(page);
+}
+
+template<typename T, size_t PageBits, size_t WindowBits>
+void PagedOrderTable<T, PageBits, WindowBits>::slide_window(uint64_t page_idx) {
+    uint64_t new_base = page_idx - window_mask;
+    uint64_t evict_end = std::min(new_base, base_page + window_pages);
+
+    for (uint64_t p = base_page; p < evict_end; ++p) {
+        Page*& page = directory[p & window_mask];
+        if (page == nullptr) {
+            continue;
+        }
+
+        uint64_t first_id = p << PageBits;
+        for (uint64_t i = 0; i < page_size && page->live > 0; ++i) {
+            T& order = page->slots[i];
+            if (order.side != Side::None) {
+                overflow.insert({first_id + i, order});
+                order = T{};
+                page->live--;
+            }
+        }
+
+        release_page(page);
+        page = nullptr;
+    }
+
+    base_page = new_base;
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+// Maps ITCH prices (4 implied decimals) of one instrument to tick indices and
+// back. Prices below 1$ trade in steps of 0.0001 and keep their value, from
+// 1$ up one index is one tick of the instrument (100 for a cent). The indices
+// are dense and monotonic, so every level store works on them unchanged, the
+// dense ladders and windows get one slot per tick instead of one per 0.0001,
+// and an index fits in a few bits less than the price it stands for.
+//
+// The division by the tick is done with the inverse of its odd part and a
+// rotate (Granlund-Montgomery), which also tells whether the price is on the
+// grid at all. A tick of 1 makes the codec the identity, every price is on
+// its grid.
+class PriceCodec {
+public:
+    static constexpr uint32_t one_dollar = 10'000;
+
+    explicit PriceCodec(uint32_t tick = 1) : tick(tick) {
+        UNEXPECTED(tick == 0, "Price codec with a zero tick");
+        shift = std::countr_zero(tick);
+        inverse = odd_inverse(tick >> shift);
+        max_ticks = UINT32_MAX / tick;
+    }
+
+    // false for a price off the grid, index is then left alone
+    bool encode(uint32_t price, uint32_t& index) const {
+        if (price < one_dollar) {
+            index = price;
+            return true;
+        }
+
+        uint32_t ticks = std::rotr((price - one_dollar) * inverse, shift);
+        if (ticks > max_ticks) [[unlikely]] {
+            return false;
+        }
+
+        index = one_dollar + ticks;
+        return true;
+    }
+
+    // reference prices (IPO, LULD collar) don't have to be on the grid, they
+    // are rounded down
+    uint32_t encode_nearest(uint32_t price) const {
+        return price < one_dollar ? price : one_dollar + (price - one_dollar) / tick;
+    }
+
+    uint32_t decode(uint32_t index) const {
+        return index < one_dollar ? index : one_dollar + (index - one_dollar) * tick;
+    }
+
+    uint32_t tick_size() const {
+        return tick;
+    }
+
+private:
+    // x * odd_inverse(x) == 1 mod 2^32, Newton's iteration doubles the correct
+    // bits on every step
+    static constexpr uint32_t odd_inverse(uint32_t odd) {
+        uint32_t inv = odd;
+        for (int i = 0; i < 5; ++i) {
+            inv *= 2 - odd * inv;
+        }
+        return inv;
+    }
+
+    uint32_t tick;
+    uint32_t shift = 0;
+    uint32_t inverse = 1;
+    uint32_t max_ticks = UINT32_MAX;
+};
+
+}
@@ -1,12 +1,12 @@
 #pragma once
 #include <cstdint>
-#include <absl/container/flat_hash_map.h>
 #include "order_book_shared.hpp"
+#include "orders/hash_order_table.hpp"
 #include "spsc_queue.hpp"
 
 namespace OB {
 
-template<template<Side> typename Levels>
+template<template<Side> typename Levels, typename Orders = HashOrderTable<>>
 class SingleStartOrderBook {
 public:
     void add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price);
@@ -21,57 +21,59 @@ public:
     SingleStartOrderBook(SPSCQueue<BestLvlChange>& change);
 
     uint64_t max_orders = 0;
-    absl::flat_hash_map<uint64_t, Order> orders_map;
+    Orders orders_map;
     Levels<Side::Bid> bid_levels;
     Levels<Side::Ask> ask_levels;
 
     SPSCQueue<BestLvlChange>& strat_queue;
 };
 
-template<template<Side> typename Levels>
- Level SingleStartOrderBook<Levels>::best_bid() {
+template<template<Side> typename Levels, typename Orders>
+ Level SingleStartOrderBook<Levels, Orders>::best_bid() {
     return bid_levels.best();
 }
 
-template<template<Side> typename Levels>
- Level SingleStartOrderBook<Levels>::best_ask() {
+template<template<Side> typename Levels, typename Orders>
+ Level SingleStartOrderBook<Levels, Orders>::best_ask() {
     return ask_levels.best();
 }
 
-template<template<Side> typename Levels>
-void SingleStartOrderBook<Levels>::add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price) {
+template<template<Side> typename Levels, typename Orders>
+void SingleStartOrderBook<Levels, Orders>::add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price) {
     Order order;
     order.qty = qty;
     order.side = side;
     order.price = price;
-    orders_map.insert({order_id, order});
 
     BestLvlChange best_lvl_change{};
 
     if (side == Side::Bid) {
-        best_lvl_change = bid_levels.add({qty, price});
+        best_lvl_change = bid_levels.add({qty, price}, order.level);
     } else {
-        best_lvl_change = ask_levels.add({qty, price});
+        best_lvl_change = ask_levels.add({qty, price}, order.level);
     }
 
+    orders_map.insert(order_id, order);
+
     if (best_lvl_change.side != Side::None) {
         bool res = strat_queue.try_push(best_lvl_change);
         UNEXPECTED(!res, "Strategy queue blocked, strategy is too slow (add order)");
     }
 }
 
-template<template<Side> typename Levels>
-void SingleStartOrderBook<Levels>::cancel_order(uint64_t order_id, uint32_t qty) {
-    UNEXPECTED(!orders_map.contains(order_id), "Cancel order did not find an order");
-    Order& order = orders_map.at(order_id);
+template<template<Side> typename Levels, typename Orders>
+void SingleStartOrderBook<Levels, Orders>::cancel_order(uint64_t order_id, uint32_t qty) {
+    Order* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Cancel order did not find an order");
+    Order& order = *order_ptr;
     UNEXPECTED(order.qty < qty, "Partial cancel order volume greater than order volume");
 
     BestLvlChange best_lvl_change{};
 
     if (order.side == Side::Bid) {
-        best_lvl_change = bid_levels.remove({qty, order.price});
+        best_lvl_change = bid_levels.remove(order.level, qty);
     } else {
-        best_lvl_change = ask_levels.remove({qty, order.price});
+        best_lvl_change = ask_levels.remove(order.level, qty);
     }
 
     if (best_lvl_change.side != Side::None) {
@@ -85,18 +87,19 @@ void SingleStartOrderBook<Levels>::cancel_order(uint64_t order_id, uint32_t qty)
     }
 }
 
-template<template<Side> typename Levels>
-void SingleStartOrderBook<Levels>::execute_order(uint64_t order_id, uint32_t qty) {
-    UNEXPECTED(!orders_map.contains(order_id), "Execute order did not find an order");
-    Order& order = orders_map.at(order_id);
+template<template<Side> typename Levels, typename Orders>
+void SingleStartOrderBook<Levels, Orders>::execute_order(uint64_t order_id, uint32_t qty) {
+    Order* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Execute order did not find an order");
+    Order& order = *order_ptr;
     UNEXPECTED(order.qty < qty, "Partial execute order volume greater than order volume");
 
     BestLvlChange best_lvl_change{};
 
     if (order.side == Side::Bid) {
-        best_lvl_change = bid_levels.remove({qty, order.price});
+        best_lvl_change = bid_levels.remove(order.level, qty);
     } else {
-        best_lvl_change = ask_levels.remove({qty, order.price});
+        best_lvl_change = ask_levels.remove(order.level, qty);
     }
 
     if (best_lvl_change.side != Side::None) {
@@ -110,26 +113,26 @@ void SingleStartOrderBook<Levels>::execute_order(uint64_t order_id, uint32_t qty
     }
 }
 
-template<template<Side> typename Levels>
-void SingleStartOrderBook<Levels>::replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price) {
-    UNEXPECTED(!orders_map.contains(order_id), "Replace order did not find an order");
-    Order& old_order = orders_map.at(order_id);
+template<template<Side> typename Levels, typename Orders>
+void SingleStartOrderBook<Levels, Orders>::replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price) {
+    Order* old_order_ptr = orders_map.find(order_id);
+    UNEXPECTED(old_order_ptr == nullptr, "Replace order did not find an order");
+    Order& old_order = *old_order_ptr;
 
     Order new_order;
     new_order.side = old_order.side;
     new_order.price = price;
     new_order.qty = qty;
-    orders_map.insert({new_order_id, new_order});
 
     BestLvlChange op1{};
     BestLvlChange op2{};
 
     if (new_order.side == Side::Bid) {
-        op1 = bid_levels.remove({old_order.qty, old_order.price});
-        op2 = bid_levels.add({qty, price});
+        op1 = bid_levels.remove(old_order.level, old_order.qty);
+        op2 = bid_levels.add({qty, price}, new_order.level);
     } else {
-        op1 = ask_levels.remove({old_order.qty, old_order.price});
-        op2 = ask_levels.add({qty, price});
+        op1 = ask_levels.remove(old_order.level, old_order.qty);
+        op2 = ask_levels.add({qty, price}, new_order.level);
     }
 
     if (op2.side != Side::None) {
@@ -141,19 +144,21 @@ void SingleStartOrderBook<Levels>::replace_order(uint64_t order_id, uint64_t new
     }
 
     orders_map.erase(order_id);
+    orders_map.insert(new_order_id, new_order);
 }
 
-template<template<Side> typename Levels>
-void SingleStartOrderBook<Levels>::delete_order(uint64_t order_id) {
-    UNEXPECTED(!orders_map.contains(order_id), "Delete order did not find an order");
-    Order& order = orders_map.at(order_id);
+template<template<Side> typename Levels, typename Orders>
+void SingleStartOrderBook<Levels, Orders>::delete_order(uint64_t order_id) {
+    Order* order_ptr = orders_map.find(order_id);
+    UNEXPECTED(order_ptr == nullptr, "Delete order did not find an order");
+    Order& order = *order_ptr;
 
     BestLvlChange best_lvl_change{};
 
     if (order.side == Side::Bid) {
-        best_lvl_change = bid_levels.remove({order.qty, order.price});
+        best_lvl_change = bid_levels.remove(order.level, order.qty);
     } else {
-        best_lvl_change = ask_levels.remove({order.qty, order.price});
+        best_lvl_change = ask_levels.remove(order.level, order.qty);
     }
 
     if (best_lvl_change.side != Side::None) {
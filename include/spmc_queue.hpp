@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <bit>
 #include <memory>
 #include <cstring>
 #include "order_book_shared.hpp"
@@ -55,8 +56,8 @@ public:
     }
 
 private:
-    // number of slots that fit in 8MB
-    constexpr static uint64_t buffer_size {8 * 1024 * 1024 / sizeof(Slot)};
+    // the largest power of two number of slots that fits in 8MB
+    constexpr static uint64_t buffer_size {std::bit_floor(8 * 1024 * 1024 / sizeof(Slot))};
     constexpr static uint64_t wrap_mask {buffer_size - 1};
 
     alignas(64) std::atomic<uint64_t> writer{0};
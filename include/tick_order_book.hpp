@@ -0,0 +1,114 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "depth_snapshot.hpp"
+#include "order_book_shared.hpp"
+#include "price_codec.hpp"
+
+namespace OB {
+
+// Runs a book in the tick space of its instrument: the prices of the order
+// messages are encoded on the way in, so the orders, the order table and the
+// level stores of Book only ever hold tick indices, and the prices handed out
+// (best level changes, best levels, depth, deltas) are decoded back to ITCH
+// prices. Book has to be told that one cent is one index, for example
+// AdaptiveOrderBook<Orders, 1> or OrderBook<TickWindowLevels>.
+//
+// The tick comes from the configuration, the feed doesn't have to keep to it.
+// The first price off the grid moves the book to the identity codec: Book
+// reprices its resting orders and levels from tick indices back to ITCH
+// prices and runs on those from then on. Slower for the dense stores, one
+// index is 0.0001 again, but nothing is lost.
+template<typename Book>
+class TickOrderBook : public Book {
+public:
+    explicit TickOrderBook(PriceCodec codec = PriceCodec()) : codec(codec) {}
+
+    BestLvlChange add_order(uint64_t order_id, Side side, uint32_t qty, uint32_t price) {
+        return decode(Book::add_order(order_id, side, qty, encode(price)));
+    }
+
+    BestLvlChange cancel_order(uint64_t order_id, uint32_t qty) {
+        return decode(Book::cancel_order(order_id, qty));
+    }
+
+    BestLvlChange execute_order(uint64_t order_id, uint32_t qty) {
+        return decode(Book::execute_order(order_id, qty));
+    }
+
+    BestLvlChange replace_order(uint64_t order_id, uint64_t new_order_id, uint32_t qty, uint32_t price) {
+        return decode(Book::replace_order(order_id, new_order_id, qty, encode(price)));
+    }
+
+    BestLvlChange delete_order(uint64_t order_id) {
+        return decode(Book::delete_order(order_id));
+    }
+
+    Level best_bid() {
+        Level level = Book::best_bid();
+        level.price = codec.decode(level.price);
+        return level;
+    }
+
+    Level best_ask() {
+        Level level = Book::best_ask();
+        level.price = codec.decode(level.price);
+        return level;
+    }
+
+    template<size_t N>
+    DepthSnapshot<N> depth() const {
+        DepthSnapshot<N> snapshot = Book::template depth<N>();
+        decode(snapshot.bid);
+        decode(snapshot.ask);
+        return snapshot;
+    }
+
+    void seed_reference_price(uint32_t price) {
+        Book::seed_reference_price(codec.encode_nearest(price));
+    }
+
+    // Book::deltas stay in tick space, this is deltas[i] with its ITCH price
+    LevelDelta delta(size_t i) const {
+        LevelDelta delta = this->deltas[i];
+        delta.price = codec.decode(delta.price);
+        return delta;
+    }
+
+    PriceCodec codec;
+
+    // books moved to the identity codec by an off-grid price, 0 or 1
+    uint64_t codec_fallbacks = 0;
+
+private:
+    uint32_t encode(uint32_t price) {
+        uint32_t index;
+        if (codec.encode(price, index)) [[likely]] {
+            return index;
+        }
+
+        fall_back();
+        return price;
+    }
+
+    [[gnu::cold, gnu::noinline]] void fall_back() {
+        PriceCodec from = codec;
+        codec = PriceCodec();
+        Book::reprice([&](uint32_t index) { return from.decode(index); });
+        codec_fallbacks++;
+    }
+
+    BestLvlChange decode(BestLvlChange change) const {
+        change.price = codec.decode(change.price);
+        return change;
+    }
+
+    template<size_t N>
+    void decode(DepthSide<N>& side) const {
+        for (uint32_t i = 0; i < side.count; ++i) {
+            side.prices[i] = codec.decode(side.prices[i]);
+        }
+    }
+};
+
+}
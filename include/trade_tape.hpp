@@ -0,0 +1,111 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "order_book_shared.hpp"
+
+namespace OB {
+
+struct TradePrint {
+    uint64_t match_number;
+    uint64_t timestamp; // ns since midnight
+    uint32_t price;
+    uint32_t qty;
+    Side aggressor;     // None for crosses and non-cross trades
+    char cross_type;    // 0 in continuous trading, else the ITCH cross type
+    bool broken;
+};
+
+static_assert(sizeof(TradePrint) == 32);
+
+// Time and sales of one instrument: the last Capacity prints in a ring next
+// to the running volume and VWAP of the day. Prints are only appended, so the
+// ring stays sorted by match number (the feed hands them out in increasing
+// order) and a BrokenTrade finds its print with a binary search instead of
+// an index kept on every trade.
+template<size_t Capacity = 1024>
+class TradeTape {
+    static_assert((Capacity & (Capacity - 1)) == 0);
+
+public:
+    const TradePrint& add(const TradePrint& print) {
+        TradePrint& slot = ring[written & (Capacity - 1)];
+        slot = print;
+        written++;
+
+        volume_ += print.qty;
+        notional += uint64_t(print.price) * print.qty;
+        return slot;
+    }
+
+    // the print still in the ring, nullptr once it has been overwritten
+    TradePrint* find(uint64_t match_number);
+
+    // marks the print broken and takes it out of the volume and the VWAP, a
+    // print which already left the ring can't be taken out
+    const TradePrint* bust(uint64_t match_number) {
+        TradePrint* print = find(match_number);
+        if (print == nullptr || print->broken) {
+            return nullptr;
+        }
+
+        print->broken = true;
+        volume_ -= print->qty;
+        notional -= uint64_t(print->price) * print->qty;
+        return print;
+    }
+
+    uint64_t volume() const {
+        return volume_;
+    }
+
+    // ITCH price units, 0 before the first print
+    uint32_t vwap() const {
+        return volume_ == 0 ? 0 : uint32_t(notional / volume_);
+    }
+
+    size_t size() const {
+        return std::min<uint64_t>(written, Capacity);
+    }
+
+    // i = 0 is the latest print
+    const TradePrint& recent(size_t i) const {
+        return ring[(written - 1 - i) & (Capacity - 1)];
+    }
+
+private:
+    std::array<TradePrint, Capacity> ring{};
+    uint64_t written = 0;
+
+    uint64_t volume_ = 0;
+    uint64_t notional = 0;
+};
+
+template<size_t Capacity>
+TradePrint* TradeTape<Capacity>::find(uint64_t match_number) {
+    uint64_t lo = written - size();
+    uint64_t hi = written;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (ring[mid & (Capacity - 1)].match_number < match_number) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo < written && ring[lo & (Capacity - 1)].match_number == match_number) {
+        return &ring[lo & (Capacity - 1)];
+    }
+
+    // a print out of order, this is a cold path anyway
+    for (uint64_t i = written - size(); i < written; ++i) {
+        if (ring[i & (Capacity - 1)].match_number == match_number) {
+            return &ring[i & (Capacity - 1)];
+        }
+    }
+    return nullptr;
+}
+
+}
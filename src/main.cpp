@@ -4,6 +4,7 @@
 #include <rte_ip4.h>
 #include <rte_udp.h>
 #include <vector>
+#include <cstdio>
 #include <iostream>
 #include <time.h>
 #include <rte_eal.h>
@@ -20,6 +21,10 @@
 #include "benchmarks/benchmark_utils.hpp"
 #include "benchmarks/example_benchmark.hpp"
 #include "benchmarks/example_benchmark_parsing.hpp"
+#include "benchmarks/level_churn_benchmark.hpp"
+#include "benchmarks/level_delta_benchmark.hpp"
+#include "benchmarks/level_search_benchmark.hpp"
+#include "benchmarks/replay_checks.hpp"
 #include "dpdk_context.hpp"
 #include "ingestor.hpp"
 #include "handler.hpp"
@@ -69,16 +74,69 @@ int main(int argc, char** argv) {
 
     std::string outdir;
 
-    if (argc != 2) {
+    if (argc < 2) {
         std::cout << "Please specify the file to parse and an output directory" << '\n';
         return 1;
     }
 
     outdir = argv[1];
+    // --conflate publishes the net best levels once per packet instead of on
+    // every message, --checkpoint=<file> checkpoints the books to the file
+    // while ingesting and --restore warm starts from it.
+    // --catch-up-seq=<seq> and --catch-up-time=<HH:MM:SS> rebuild the books
+    // without publishing until the sequence or the feed time is reached.
+    // --no-prefilter decodes every message of the feed, for comparing the
+    // ns/packet against the locate prefilter. --batch parses every packet in
+    // two passes, --batch-by-type also groups the dispatch by message type.
+    // --self-check replays synthetic feeds through the books and the handler
+    // against their known outcome and exits, see replay_checks.hpp
+    bool conflate = false;
+    bool self_check = false;
+    bool prefilter = true;
+    ITCH::ParseMode parse_mode = ITCH::ParseMode::Sequential;
+    bool restore = false;
+    std::string checkpoint_path;
+    uint64_t catch_up_seq = 0;
+    uint64_t catch_up_timestamp = 0;
+    for (int i = 2; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--conflate") {
+            conflate = true;
+        } else if (arg == "--batch") {
+            parse_mode = ITCH::ParseMode::Batched;
+        } else if (arg == "--batch-by-type") {
+            parse_mode = ITCH::ParseMode::BatchedByType;
+        } else if (arg == "--self-check") {
+            self_check = true;
+        } else if (arg == "--no-prefilter") {
+            prefilter = false;
+        } else if (arg == "--restore") {
+            restore = true;
+        } else if (arg.starts_with("--checkpoint=")) {
+            checkpoint_path = arg.substr(std::string_view("--checkpoint=").size());
+        } else if (arg.starts_with("--catch-up-seq=")) {
+            catch_up_seq = std::stoull(std::string(arg.substr(std::string_view("--catch-up-seq=").size())));
+        } else if (unsigned h, m, sec; std::sscanf(argv[i], "--catch-up-time=%u:%u:%u", &h, &m, &sec) == 3) {
+            catch_up_timestamp = ((h * 60 + m) * 60 + sec) * 1'000'000'000ull;
+        } else {
+            std::cout << "Unknown option " << arg << '\n';
+            return 1;
+        }
+    }
+
+    if (self_check) {
+        return run_replay_checks(outdir) ? 0 : 1;
+    }
 
     ITCH::ItchParser parser;
     BenchmarkOrderBook ob_bm_handler;
+    BenchmarkPagedOrderBook ob_paged_bm_handler;
+    BenchmarkL3OrderBook ob_l3_bm_handler;
     BenchmarkParsing parsing_bm_handler;
+    BenchmarkParsingOrderFields order_fields_bm_handler;
+    BenchmarkParsingOrderViews order_views_bm_handler;
+    BenchmarkLevelDistance level_distance_bm_handler;
+    BenchmarkLevelDeltas level_delta_bm_handler;
 
     std::vector<Handler::InstrumentConfig> instrument_config;
     Handler::Queue nvda_queue;
@@ -151,9 +209,19 @@ int main(int argc, char** argv) {
         }
     }
 
-    Handler handler(instrument_config);
+    Handler handler(instrument_config, conflate);
+    handler.set_prefilter(prefilter);
+    if (!checkpoint_path.empty()) {
+        handler.enable_checkpoints(checkpoint_path);
+        if (restore && !handler.restore(checkpoint_path)) {
+            std::cerr << "No usable checkpoint in " << checkpoint_path << ", starting from the open\n";
+        }
+    }
+    if (catch_up_seq != 0 || catch_up_timestamp != 0) {
+        handler.start_catch_up(catch_up_seq, catch_up_timestamp);
+    }
 
-    ITCH::Ingestor<Handler> ingestor(handler, dpdk_context);
+    ITCH::Ingestor<Handler> ingestor(handler, dpdk_context, parse_mode);
     ingestor.ingest_messages();
 
     for (auto& consumer_thread : consumer_threads) {